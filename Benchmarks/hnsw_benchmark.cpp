@@ -0,0 +1,139 @@
+//
+//  hnsw_benchmark.cpp
+//
+//  Recall versus latency of the HNSW neighbor index against the exact similarities, on random
+//  clustered embeddings inserted one by one like the clustering does.
+//
+//  Build and run from the repository root:
+//  c++ -std=c++14 -O3 -I Sources/CClustering Benchmarks/hnsw_benchmark.cpp Sources/CClustering/hnsw_index.cpp Sources/CClustering/kernels.cpp Sources/CClustering/matrix.cpp -o hnsw_benchmark
+//  ./hnsw_benchmark [items] [hidden_size] [threshold]
+//
+
+#include "hnsw_index.hpp"
+#include "kernels.hpp"
+#include "matrix.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+
+struct Configuration {
+    uint16_t m;
+    uint16_t ef_construction;
+    uint16_t ef_search;
+};
+
+static double measure(const std::function<void()> &function) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    function();
+    
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1e9;
+}
+
+// Items are spread around items / 20 random topics so that every item has a few neighbors above
+// the threshold, like pages of a same website.
+static Matrix clustered_embeddings(const size_t items, const size_t hidden_size) {
+    std::mt19937 generator(42);
+    std::normal_distribution<float> distribution;
+    std::vector<std::vector<float>> topics(std::max<size_t>(items / 20, 1), std::vector<float>(hidden_size));
+    Matrix embeddings(hidden_size);
+    
+    for (std::vector<float> &topic : topics) {
+        for (float &value : topic) {
+            value = distribution(generator);
+        }
+    }
+    
+    for (size_t i = 0;i < items;i++) {
+        const std::vector<float> &topic = topics[generator() % topics.size()];
+        double norm = 0;
+        
+        embeddings.insert_row(i);
+        
+        float* row = embeddings.row(i);
+        
+        for (size_t k = 0;k < hidden_size;k++) {
+            row[k] = topic[k] + 1.2 * distribution(generator);
+            norm += row[k] * row[k];
+        }
+        
+        for (size_t k = 0;k < hidden_size;k++) {
+            row[k] /= std::sqrt(norm);
+        }
+    }
+    
+    return embeddings;
+}
+
+int main(int argc, char** argv) {
+    size_t items = argc > 1 ? std::atoi(argv[1]) : 10000;
+    size_t hidden_size = argc > 2 ? std::atoi(argv[2]) : 384;
+    float threshold = argc > 3 ? std::atof(argv[3]) : 0.4659;
+    Matrix embeddings = clustered_embeddings(items, hidden_size);
+    std::vector<std::vector<uint32_t>> exact_neighbors(items);
+    // The packed matrix alone needs 2 n^2 bytes, the full rebuild is only measured while it fits.
+    bool measure_rebuild = items <= 20000;
+    std::vector<float> packed_similarities(measure_rebuild ? items * (items + 1) / 2 : 0);
+    size_t exact_pairs = 0;
+    
+    std::printf("%zu items, hidden size %zu, threshold %.4f, instruction set %s\n", items, hidden_size, threshold, kernels::instruction_set());
+    
+    // Exact references: the full rebuild of the packed matrix, and the row computed on each insert.
+    double rebuild_seconds = measure([&]() {
+        if (measure_rebuild) {
+            kernels::packed_gram_matrix(embeddings.data(), items, embeddings.row_stride(), embeddings.row_stride(), packed_similarities.data());
+        }
+    });
+    double exact_seconds = measure([&]() {
+        for (size_t i = 0;i < items;i++) {
+            for (size_t j = 0;j < i;j++) {
+                if (kernels::dot_product(embeddings.row(i), embeddings.row(j), hidden_size) >= threshold) {
+                    exact_neighbors[i].push_back(j);
+                }
+            }
+        }
+    });
+    
+    for (const std::vector<uint32_t> &neighbors : exact_neighbors) {
+        exact_pairs += neighbors.size();
+    }
+    
+    std::printf("%zu pairs at or above the threshold\n", exact_pairs);
+    std::printf("%-26s %12s %12s %10s %10s\n", "strategy", "total ms", "us / insert", "recall", "memory MB");
+    
+    if (measure_rebuild) {
+        std::printf("%-26s %12.2f %12s %10s %10.1f\n", "exact full rebuild", rebuild_seconds * 1000, "-", "1.0000", sizeof(float) * packed_similarities.size() / 1e6);
+    }
+    
+    std::printf("%-26s %12.2f %12.2f %10s %10s\n", "exact row per insert", exact_seconds * 1000, exact_seconds * 1e6 / items, "1.0000", "-");
+    
+    std::vector<Configuration> configurations = {{8, 100, 16}, {16, 200, 16}, {16, 200, 64}, {32, 200, 64}, {32, 400, 128}};
+    
+    for (const Configuration &configuration : configurations) {
+        HnswIndex index(hidden_size, configuration.m, configuration.ef_construction, configuration.ef_search);
+        size_t found_pairs = 0;
+        double seconds = measure([&]() {
+            for (size_t i = 0;i < items;i++) {
+                std::vector<SimilarityEdge> neighbors = index.search(embeddings.row(i), threshold);
+                
+                index.insert(i, embeddings.row(i));
+                
+                for (const SimilarityEdge &edge : neighbors) {
+                    found_pairs += std::binary_search(exact_neighbors[i].begin(), exact_neighbors[i].end(), edge.item);
+                }
+            }
+        });
+        char name[64];
+        
+        std::snprintf(name, sizeof(name), "hnsw M=%u efC=%u efS=%u", configuration.m, configuration.ef_construction, configuration.ef_search);
+        std::printf("%-26s %12.2f %12.2f %10.4f %10.1f\n", name, seconds * 1000, seconds * 1e6 / items, exact_pairs > 0 ? found_pairs / double(exact_pairs) : 1.0, index.memory_size() / 1e6);
+    }
+    
+    return 0;
+}
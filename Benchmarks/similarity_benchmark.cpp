@@ -0,0 +1,131 @@
+//
+//  similarity_benchmark.cpp
+//
+//  Compares the full similarity matrix rebuild strategies on random embeddings.
+//
+//  Build and run from the repository root:
+//  c++ -std=c++14 -O3 -I Sources/CClustering Benchmarks/similarity_benchmark.cpp Sources/CClustering/kernels.cpp Sources/CClustering/matrix.cpp -o similarity_benchmark
+//  ./similarity_benchmark [items] [hidden_size]
+//
+
+#include "kernels.hpp"
+#include "matrix.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <vector>
+
+
+// The per pair implementation the clustering used before the kernels existed.
+static std::vector<float> legacy_normalize(const std::vector<float> &vector) {
+    double norm_value = std::sqrt(std::inner_product(vector.begin(), vector.end(), vector.begin(), 0.0));
+    std::vector<float> normalized_vector;
+    
+    for (size_t i = 0; i < vector.size(); i++) {
+        normalized_vector.push_back(vector[i] / norm_value);
+    }
+    
+    return normalized_vector;
+}
+
+static void legacy_cosine_similarity_matrix(const std::vector<std::vector<float>> &embeddings, std::vector<std::vector<float>> &similarities) {
+    similarities.clear();
+    
+    for (size_t i = 0;i < embeddings.size();i++) {
+        std::vector<float> current_cosine_similarities;
+        
+        for (size_t j = 0;j < embeddings.size();j++) {
+            std::vector<float> vector1_norm = legacy_normalize(embeddings[i]);
+            std::vector<float> vector2_norm = legacy_normalize(embeddings[j]);
+            std::vector<float> zeros(embeddings[i].size(), 0);
+            
+            if (vector1_norm == zeros || vector2_norm == zeros) {
+                current_cosine_similarities.push_back(0.0);
+                continue;
+            }
+            
+            current_cosine_similarities.push_back(std::inner_product(vector1_norm.begin(), vector1_norm.end(), vector2_norm.begin(), 0.0));
+        }
+        
+        similarities.push_back(current_cosine_similarities);
+    }
+}
+
+static void pairwise_similarity_matrix(const Matrix &embeddings, Matrix &similarities) {
+    similarities.reset(embeddings.size(), embeddings.size());
+    
+    for (size_t i = 0;i < embeddings.size();i++) {
+        for (size_t j = 0;j < embeddings.size();j++) {
+            similarities.row(i)[j] = kernels::dot_product(embeddings.row(i), embeddings.row(j), embeddings.columns());
+        }
+    }
+}
+
+static double measure(const std::function<void()> &function) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    function();
+    
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1e9;
+}
+
+static void report(const char* name, const double seconds, const size_t items, const size_t hidden_size) {
+    double flops = 2.0 * items * items * hidden_size;
+    
+    std::printf("%-28s %10.2f ms %10.2f GFLOP/s\n", name, seconds * 1000, flops / seconds / 1e9);
+}
+
+int main(int argc, char** argv) {
+    size_t items = argc > 1 ? std::atoi(argv[1]) : 2000;
+    size_t hidden_size = argc > 2 ? std::atoi(argv[2]) : 384;
+    std::mt19937 generator(42);
+    std::normal_distribution<float> distribution;
+    std::vector<std::vector<float>> raw_embeddings(items, std::vector<float>(hidden_size));
+    Matrix embeddings(hidden_size);
+    
+    for (size_t i = 0;i < items;i++) {
+        for (size_t k = 0;k < hidden_size;k++) {
+            raw_embeddings[i][k] = distribution(generator);
+        }
+        
+        std::vector<float> normalized = legacy_normalize(raw_embeddings[i]);
+        
+        embeddings.insert_row(i);
+        std::copy(normalized.begin(), normalized.end(), embeddings.row(i));
+    }
+    
+    std::printf("%zu items, hidden size %zu, instruction set %s\n", items, hidden_size, kernels::instruction_set());
+    
+    std::vector<std::vector<float>> legacy_similarities;
+    Matrix pairwise_similarities;
+    Matrix scalar_similarities;
+    Matrix gram_similarities;
+    
+    report("legacy per pair", measure([&]() { legacy_cosine_similarity_matrix(raw_embeddings, legacy_similarities); }), items, hidden_size);
+    report("dispatched dot per pair", measure([&]() { pairwise_similarity_matrix(embeddings, pairwise_similarities); }), items, hidden_size);
+    report("blocked gram (scalar)", measure([&]() {
+        scalar_similarities.reset(items, items);
+        kernels::gram_matrix_scalar(embeddings.data(), items, embeddings.row_stride(), embeddings.row_stride(), scalar_similarities.data(), scalar_similarities.row_stride());
+    }), items, hidden_size);
+    report("blocked gram (dispatched)", measure([&]() {
+        gram_similarities.reset(items, items);
+        kernels::gram_matrix(embeddings.data(), items, embeddings.row_stride(), embeddings.row_stride(), gram_similarities.data(), gram_similarities.row_stride());
+    }), items, hidden_size);
+    
+    float max_error = 0;
+    
+    for (size_t i = 0;i < items;i++) {
+        for (size_t j = 0;j < items;j++) {
+            max_error = std::max(max_error, std::fabs(gram_similarities.row(i)[j] - legacy_similarities[i][j]));
+        }
+    }
+    
+    std::printf("max absolute difference with the legacy matrix: %g\n", max_error);
+    
+    return 0;
+}
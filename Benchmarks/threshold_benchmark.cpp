@@ -0,0 +1,155 @@
+//
+//  threshold_benchmark.cpp
+//
+//  Compares the threshold calibration sweeping only the similarities with the former 10,000 steps
+//  sweep clustering again at every step, on random clustered embeddings, with one thread and with
+//  the given number of threads.
+//
+//  Build and run from the repository root:
+//  c++ -std=c++14 -O3 -pthread -I Sources/CClustering Benchmarks/threshold_benchmark.cpp Sources/CClustering/threshold_sweep.cpp Sources/CClustering/similarity_matrix.cpp Sources/CClustering/union_find.cpp Sources/CClustering/kernels.cpp Sources/CClustering/matrix.cpp -o threshold_benchmark
+//  ./threshold_benchmark [items] [hidden_size] [measured_steps] [threads]
+//
+
+#include "threshold_sweep.hpp"
+#include "similarity_matrix.hpp"
+#include "matrix.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+static double measure(const std::function<void()> &function) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    function();
+    
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1e9;
+}
+
+// Items are spread around items / 10 random topics, the expected clusters are the topics.
+static Matrix clustered_embeddings(const size_t items, const size_t hidden_size, std::vector<uint32_t> &expected_size) {
+    std::mt19937 generator(42);
+    std::normal_distribution<float> distribution;
+    std::vector<std::vector<float>> topics(std::max<size_t>(items / 10, 1), std::vector<float>(hidden_size));
+    Matrix embeddings(hidden_size);
+    
+    expected_size.assign(topics.size(), 0);
+    
+    for (std::vector<float> &topic : topics) {
+        for (float &value : topic) {
+            value = distribution(generator);
+        }
+    }
+    
+    for (size_t i = 0;i < items;i++) {
+        size_t topic = generator() % topics.size();
+        double norm = 0;
+        
+        embeddings.insert_row(i);
+        expected_size[topic]++;
+        
+        float* row = embeddings.row(i);
+        
+        for (size_t k = 0;k < hidden_size;k++) {
+            row[k] = topics[topic][k] + 1.2 * distribution(generator);
+            norm += row[k] * row[k];
+        }
+        
+        for (size_t k = 0;k < hidden_size;k++) {
+            row[k] /= std::sqrt(norm);
+        }
+    }
+    
+    std::sort(expected_size.rbegin(), expected_size.rend());
+    expected_size.erase(std::remove(expected_size.begin(), expected_size.end(), 0), expected_size.end());
+    
+    return embeddings;
+}
+
+// The greedy clusters computed from scratch like the clustering did at every step of the former
+// sweep, reduced to their sizes.
+static std::vector<uint32_t> legacy_clusters_size(const SimilarityMatrix &similarities, const float threshold) {
+    std::vector<std::vector<uint32_t>> candidates;
+    std::vector<bool> extracted_items(similarities.size(), false);
+    std::vector<uint32_t> clusters_size;
+    
+    for (size_t i = 0;i < similarities.size();i++) {
+        std::vector<uint32_t> members;
+        SimilarityRow row = similarities[i];
+        
+        for (size_t j = 0;j < row.size();j++) {
+            if (row[j] > threshold) {
+                members.push_back(j);
+            }
+        }
+        
+        if (!members.empty()) {
+            candidates.push_back(members);
+        }
+    }
+    
+    std::stable_sort(candidates.begin(), candidates.end(), [](const std::vector<uint32_t> &a, const std::vector<uint32_t> &b){ return a.size() > b.size(); });
+    
+    for (const std::vector<uint32_t> &candidate : candidates) {
+        uint32_t owned = 0;
+        
+        for (const uint32_t member : candidate) {
+            owned += !extracted_items[member];
+            extracted_items[member] = true;
+        }
+        
+        if (owned > 0) {
+            clusters_size.push_back(owned);
+        }
+    }
+    
+    return clusters_size;
+}
+
+int main(int argc, char** argv) {
+    size_t items = argc > 1 ? std::atoi(argv[1]) : 2000;
+    size_t hidden_size = argc > 2 ? std::atoi(argv[2]) : 384;
+    size_t measured_steps = argc > 3 ? std::atoi(argv[3]) : 100;
+    uint16_t threads = argc > 4 ? std::atoi(argv[4]) : std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<uint32_t> expected_size;
+    Matrix embeddings = clustered_embeddings(items, hidden_size, expected_size);
+    SimilarityMatrix similarities;
+    std::vector<bool> null_items(items, false);
+    
+    similarities.compute(embeddings);
+    
+    std::printf("%zu items, hidden size %zu, %zu expected clusters\n", items, hidden_size, expected_size.size());
+    std::printf("%-40s %12s %12s\n", "strategy", "total ms", "threshold");
+    
+    // The former sweep takes minutes from a few thousand items, only its first steps are measured.
+    double legacy_seconds = measure([&]() {
+        for (size_t step = 1;step <= measured_steps;step++) {
+            legacy_clusters_size(similarities, step * 0.0001);
+        }
+    });
+    
+    std::printf("%-40s %12.2f %12s\n", "10,000 steps (extrapolated)", legacy_seconds * 1000 * 10000 / measured_steps, "-");
+    
+    for (const bool connected_components : {false, true}) {
+        for (const uint16_t sweep_threads : {uint16_t(1), threads}) {
+            std::tuple<float, float> best;
+            double seconds = measure([&]() {
+                ThresholdSweep sweep(similarities, null_items, 0, sweep_threads);
+                
+                best = connected_components ? sweep.connected_components(expected_size) : sweep.greedy(expected_size);
+            });
+            
+            std::string name = std::string(connected_components ? "sweep, connected components, " : "sweep, greedy, ") + std::to_string(sweep_threads) + " threads";
+            std::printf("%-40s %12.2f %12.6f\n", name.c_str(), seconds * 1000, std::get<0>(best));
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,93 @@
+//
+//  centroid_index.cpp
+//
+
+#include "centroid_index.hpp"
+#include "kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const uint32_t CentroidIndex::no_cluster;
+
+// A cluster gets the first free slot, and frees it when its last item leaves.
+void CentroidIndex::add(const uint32_t id, const float* embedding, const int sign) {
+    size_t slot = std::find(this->slot_ids.begin(), this->slot_ids.end(), id) - this->slot_ids.begin();
+    
+    if (slot == this->slot_ids.size()) {
+        slot = std::find(this->slot_ids.begin(), this->slot_ids.end(), CentroidIndex::no_cluster) - this->slot_ids.begin();
+        
+        if (slot == this->slot_ids.size()) {
+            this->slot_ids.push_back(CentroidIndex::no_cluster);
+            this->counts.push_back(0);
+            this->sums.resize(this->sums.size() + this->dimensions, 0);
+        }
+        
+        this->slot_ids[slot] = id;
+    }
+    
+    float* sum = this->sums.data() + slot * this->dimensions;
+    
+    for (size_t k = 0;k < this->dimensions;k++) {
+        sum[k] += sign * embedding[k];
+    }
+    
+    this->counts[slot] += sign;
+    
+    if (this->counts[slot] == 0) {
+        this->slot_ids[slot] = CentroidIndex::no_cluster;
+        std::fill(sum, sum + this->dimensions, 0);
+    }
+}
+
+void CentroidIndex::insert(const size_t idx) {
+    this->item_ids.insert(this->item_ids.begin() + idx, CentroidIndex::no_cluster);
+}
+
+void CentroidIndex::erase(const size_t idx, const float* embedding) {
+    this->assign(idx, embedding, CentroidIndex::no_cluster);
+    this->item_ids.erase(this->item_ids.begin() + idx);
+}
+
+void CentroidIndex::assign(const size_t idx, const float* embedding, const uint32_t id) {
+    if (this->item_ids[idx] == id) {
+        return;
+    }
+    
+    if (this->item_ids[idx] != CentroidIndex::no_cluster) {
+        this->add(this->item_ids[idx], embedding, -1);
+    }
+    
+    if (id != CentroidIndex::no_cluster) {
+        this->add(id, embedding, 1);
+    }
+    
+    this->item_ids[idx] = id;
+}
+
+std::tuple<uint32_t, float> CentroidIndex::nearest(const float* embedding) const {
+    uint32_t best_id = CentroidIndex::no_cluster;
+    float best_similarity = -std::numeric_limits<float>::infinity();
+    
+    for (size_t slot = 0;slot < this->slot_ids.size();slot++) {
+        if (this->slot_ids[slot] == CentroidIndex::no_cluster) {
+            continue;
+        }
+        
+        const float* sum = this->sums.data() + slot * this->dimensions;
+        float norm = std::sqrt(kernels::dot_product(sum, sum, this->dimensions));
+        
+        if (norm == 0) {
+            continue;
+        }
+        
+        float similarity = kernels::dot_product(embedding, sum, this->dimensions) / norm;
+        
+        if (similarity > best_similarity) {
+            best_id = this->slot_ids[slot];
+            best_similarity = similarity;
+        }
+    }
+    
+    return std::make_tuple(best_id, best_similarity);
+}
@@ -0,0 +1,42 @@
+//
+//  centroid_index.hpp
+//
+
+#ifndef centroid_index_hpp
+#define centroid_index_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+// Running sum and count of the normalized embeddings of every cluster, designated by its stable
+// id, so that a new item is compared with the k centroids in O(k·d) instead of with the n items.
+// Moving an item from a cluster to another costs O(d). Items can be inserted or erased at any
+// position like in the similarity matrix.
+class CentroidIndex {
+    private:
+        size_t dimensions;
+        std::vector<float> sums;
+        std::vector<uint32_t> counts;
+        // Cluster of every slot of sums, no_cluster for the free ones.
+        std::vector<uint32_t> slot_ids;
+        std::vector<uint32_t> item_ids;
+        
+        void add(const uint32_t id, const float* embedding, const int sign);
+    public:
+        static const uint32_t no_cluster = UINT32_MAX;
+        
+        explicit CentroidIndex(const size_t dimensions) : dimensions(dimensions) {}
+        
+        // Insert an item in no cluster before idx.
+        void insert(const size_t idx);
+        void erase(const size_t idx, const float* embedding);
+        // Move the item at idx to a cluster, no_cluster taking it out of every centroid.
+        void assign(const size_t idx, const float* embedding, const uint32_t id);
+        // Id of the centroid most similar to a normalized embedding and their cosine similarity,
+        // no_cluster when there is no centroid.
+        std::tuple<uint32_t, float> nearest(const float* embedding) const;
+};
+
+#endif /* centroid_index_hpp */
@@ -0,0 +1,127 @@
+//
+//  cluster_tracker.cpp
+//
+
+#include "cluster_tracker.hpp"
+#include <algorithm>
+
+
+const uint32_t ClusterTracker::no_cluster;
+
+void ClusterTracker::insert(const size_t idx) {
+    this->item_clusters.insert(this->item_clusters.begin() + idx, ClusterTracker::no_cluster);
+}
+
+void ClusterTracker::erase(const size_t idx) {
+    this->item_clusters.erase(this->item_clusters.begin() + idx);
+}
+
+// Whether the previous cluster with this id has already been given to a new cluster.
+bool ClusterTracker::matched(const uint32_t previous_id) {
+    return this->matched_ids[std::lower_bound(this->previous_ids.begin(), this->previous_ids.end(), previous_id) - this->previous_ids.begin()];
+}
+
+template<typename Index>
+void ClusterTracker::update(const std::vector<Index> &indices, const std::vector<Index> &clusters_size, ClusterChanges &changes) {
+    size_t offset = 0;
+    
+    this->overlaps.clear();
+    
+    // Count, for every new cluster, the items it shares with each previous cluster.
+    for (uint32_t cluster = 0;cluster < clusters_size.size();cluster++) {
+        this->member_ids.clear();
+        
+        for (size_t i = offset;i < offset + clusters_size[cluster];i++) {
+            // Items left out of a clustering keep the id of a cluster that may be gone since.
+            if (std::binary_search(this->previous_ids.begin(), this->previous_ids.end(), this->item_clusters[indices[i]])) {
+                this->member_ids.push_back(this->item_clusters[indices[i]]);
+            }
+        }
+        
+        std::sort(this->member_ids.begin(), this->member_ids.end());
+        
+        for (size_t i = 0;i < this->member_ids.size();) {
+            size_t j = i;
+            
+            while (j < this->member_ids.size() && this->member_ids[j] == this->member_ids[i]) {
+                j++;
+            }
+            
+            this->overlaps.push_back(Overlap{uint32_t(j - i), cluster, this->member_ids[i]});
+            i = j;
+        }
+        
+        offset += clusters_size[cluster];
+    }
+    
+    std::sort(this->overlaps.begin(), this->overlaps.end(), [](const Overlap &a, const Overlap &b){
+        if (a.items != b.items) {
+            return a.items > b.items;
+        }
+        
+        return a.cluster != b.cluster ? a.cluster < b.cluster : a.previous_id < b.previous_id;
+    });
+    
+    std::vector<uint32_t> new_ids(clusters_size.size(), ClusterTracker::no_cluster);
+    
+    this->matched_ids.assign(this->previous_ids.size(), false);
+    
+    for (const Overlap &overlap : this->overlaps) {
+        size_t previous = std::lower_bound(this->previous_ids.begin(), this->previous_ids.end(), overlap.previous_id) - this->previous_ids.begin();
+        
+        if (new_ids[overlap.cluster] == ClusterTracker::no_cluster && !this->matched_ids[previous]) {
+            new_ids[overlap.cluster] = overlap.previous_id;
+            this->matched_ids[previous] = true;
+        }
+    }
+    
+    changes = ClusterChanges();
+    
+    for (uint32_t &id : new_ids) {
+        if (id == ClusterTracker::no_cluster) {
+            id = this->next_id++;
+            changes.created_clusters.push_back(id);
+        }
+    }
+    
+    for (size_t previous = 0;previous < this->previous_ids.size();previous++) {
+        if (!this->matched_ids[previous]) {
+            changes.removed_clusters.push_back(this->previous_ids[previous]);
+        }
+    }
+    
+    for (const Overlap &overlap : this->overlaps) {
+        bool survives = this->matched(overlap.previous_id);
+        bool created = !std::binary_search(this->previous_ids.begin(), this->previous_ids.end(), new_ids[overlap.cluster]);
+        
+        if (!survives && !created) {
+            changes.merged_from.push_back(overlap.previous_id);
+            changes.merged_into.push_back(new_ids[overlap.cluster]);
+        } else if (created) {
+            changes.split_from.push_back(overlap.previous_id);
+            changes.split_into.push_back(new_ids[overlap.cluster]);
+        }
+    }
+    
+    offset = 0;
+    
+    for (uint32_t cluster = 0;cluster < clusters_size.size();cluster++) {
+        for (size_t i = offset;i < offset + clusters_size[cluster];i++) {
+            if (this->item_clusters[indices[i]] != new_ids[cluster]) {
+                this->item_clusters[indices[i]] = new_ids[cluster];
+                changes.moved_items.push_back(indices[i]);
+                changes.moved_clusters.push_back(new_ids[cluster]);
+            }
+        }
+        
+        offset += clusters_size[cluster];
+    }
+    
+    this->cluster_ids = new_ids;
+    this->previous_ids = new_ids;
+    std::sort(this->previous_ids.begin(), this->previous_ids.end());
+    changes.version = ++this->version;
+}
+
+template void ClusterTracker::update<uint16_t>(const std::vector<uint16_t> &indices, const std::vector<uint16_t> &clusters_size, ClusterChanges &changes);
+template void ClusterTracker::update<uint32_t>(const std::vector<uint32_t> &indices, const std::vector<uint32_t> &clusters_size, ClusterChanges &changes);
@@ -0,0 +1,64 @@
+//
+//  cluster_tracker.hpp
+//
+
+#ifndef cluster_tracker_hpp
+#define cluster_tracker_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Changes between two consecutive clusterings, clusters are designated by their stable ids.
+struct ClusterChanges {
+    uint64_t version = 0;
+    // Items, by position, whose cluster changed and the id of their new cluster. The inserted items
+    // are always listed.
+    std::vector<uint32_t> moved_items;
+    std::vector<uint32_t> moved_clusters;
+    std::vector<uint32_t> created_clusters;
+    std::vector<uint32_t> removed_clusters;
+    // A removed cluster whose items went into a cluster that existed before.
+    std::vector<uint32_t> merged_from;
+    std::vector<uint32_t> merged_into;
+    // A created cluster that took items from a cluster that still exists.
+    std::vector<uint32_t> split_from;
+    std::vector<uint32_t> split_into;
+};
+
+// Gives the clusters ids that survive across the clusterings: every new cluster takes over the id
+// of the previous cluster it shares the most items with, the overlaps being matched from the
+// largest one, and the clusters left unmatched get a new id.
+class ClusterTracker {
+    private:
+        struct Overlap {
+            uint32_t items;
+            uint32_t cluster;
+            uint32_t previous_id;
+        };
+        
+        std::vector<uint32_t> item_clusters;
+        std::vector<uint32_t> cluster_ids;
+        std::vector<uint32_t> previous_ids;
+        std::vector<bool> matched_ids;
+        std::vector<Overlap> overlaps;
+        std::vector<uint32_t> member_ids;
+        uint32_t next_id = 0;
+        uint64_t version = 0;
+        
+        bool matched(const uint32_t previous_id);
+    public:
+        static const uint32_t no_cluster = UINT32_MAX;
+        
+        uint64_t get_version() const { return this->version; }
+        const std::vector<uint32_t>& get_cluster_ids() const { return this->cluster_ids; }
+        
+        void insert(const size_t idx);
+        void erase(const size_t idx);
+        // Take the clustering encoded as in the results, indices grouped by cluster and the size of
+        // every cluster, and report what changed since the previous one.
+        template<typename Index>
+        void update(const std::vector<Index> &indices, const std::vector<Index> &clusters_size, ClusterChanges &changes);
+};
+
+#endif /* cluster_tracker_hpp */
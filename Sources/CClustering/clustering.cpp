@@ -6,335 +6,1070 @@
 
 #include "clustering.hpp"
 
+constexpr size_t Clustering::min_indexed_items;
+constexpr int Clustering::null_owner;
+constexpr int Clustering::no_owner;
 
-Model::Model(std::string model_path, uint16_t hidden_size) {
-    std::string str_model_path(model_path);
-    this->env = std::make_unique<Ort::Env>(OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR, "clustering");
-    Ort::SessionOptions sessionOptions;
+Clustering::Clustering(const float threshold, std::unique_ptr<TextEncoder> encoder) : encoder(std::move(encoder)), embeddings(this->encoder->get_hidden_size()), centroids(this->encoder->get_hidden_size()), scheduler(this->encoder->get_hidden_size(), [this](const std::vector<int32_t>* input_ids, const size_t batch_size, float* embeddings){ return this->encoder->predict_batch(input_ids, batch_size, embeddings); }), staged_embedding(this->encoder->get_hidden_size()) {
+    if (threshold > 0) {
+        this->threshold = threshold;
+    }
+}
+
+inline float Clustering::norm(const RowView<const float> vector) {
+    float sum = std::inner_product(vector.begin(), vector.end(), vector.begin(), 0.0);
     
-    sessionOptions.SetIntraOpNumThreads(4);
-    sessionOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+    return std::sqrt(sum);
+}
+
+inline void Clustering::normalize(const RowView<float> vector) {
+    double norm_value = this->norm(vector);
     
-    this->session = std::make_unique<Ort::Session>(*this->env, model_path.data(), sessionOptions);
-    this->hidden_size = hidden_size;
+    if (norm_value > 0) {
+        for (int i = 0; i < vector.size(); i++) {
+            vector[i] = vector[i] / norm_value;
+        }
+    }
 }
 
-std::tuple<std::vector<float>, float> Model::predict(std::vector<int32_t> input_ids) {
-    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
-    Ort::AllocatorWithDefaultOptions allocator;
-    size_t num_input_nodes = this->session->GetInputCount();
-    size_t num_output_nodes = this->session->GetOutputCount();
-    std::vector<const char*> input_node_names(num_input_nodes);
-    std::vector<const char*> output_node_names(num_output_nodes);
-    std::vector<int32_t> attention_mask(input_ids.size(), 1);
-    std::vector<int32_t> token_type_ids(input_ids.size(), 0);
-    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    std::vector<int64_t> input_node_dims = {1, static_cast<int64_t>(input_ids.size())};
-    std::vector<Ort::Value> ort_inputs;
+// Embeddings are stored normalized, so the cosine similarity is a plain dot product.
+inline float Clustering::cosine_similarity(const int i, const int j) {
+    if (this->zero_embeddings[i] || this->zero_embeddings[j]) {
+        return 0.0;
+    }
     
-    ort_inputs.emplace_back(Ort::Value::CreateTensor<int32_t>(memory_info, const_cast<int32_t*>(input_ids.data()), input_ids.size(), input_node_dims.data(), input_node_dims.size()));
-    ort_inputs.emplace_back(Ort::Value::CreateTensor<int32_t>(memory_info, const_cast<int32_t*>(attention_mask.data()), attention_mask.size(), input_node_dims.data(), input_node_dims.size()));
-    ort_inputs.emplace_back(Ort::Value::CreateTensor<int32_t>(memory_info, const_cast<int32_t*>(token_type_ids.data()), token_type_ids.size(), input_node_dims.data(), input_node_dims.size()));
+    return kernels::dot_product(this->embeddings.row(i), this->embeddings.row(j), this->embeddings.columns());
+}
+
+// Normalize the embedding into the row of the item at idx, already inserted.
+void Clustering::store_embedding(const int idx, const std::vector<float> &embedding) {
+    RowView<float> row = this->embeddings[idx];
+    
+    std::copy(embedding.begin(), embedding.begin() + row.size(), row.begin());
+    this->normalize(row);
+    this->zero_embeddings[idx] = std::all_of(row.begin(), row.end(), [](float value){return value == 0;});
+}
+
+void Clustering::insert_embedding(const int idx, const std::vector<float> &embedding) {
+    this->embeddings.insert_row(idx);
+    this->zero_embeddings.insert(this->zero_embeddings.begin() + idx, false);
+    this->store_embedding(idx, embedding);
     
-    for (int i = 0; i < num_input_nodes; i++) {
-        char* input_name = this->session->GetInputName(i, allocator);
-        input_node_names[i] = input_name;
+    if (this->neighbor_index) {
+        this->neighbor_index->insert(idx, this->embeddings.row(idx));
+    } else if (this->neighbor_m > 0 && this->embeddings.size() >= Clustering::min_indexed_items) {
+        this->build_neighbor_index();
     }
+}
+
+// Insert the items, sorted by position, each at its position once all are inserted, with their
+// embedding and their similarities. The embeddings and the similarities are resized once and only
+// the similarities of the new items are computed.
+void Clustering::insert_items(const std::vector<std::pair<int, std::vector<float>>> &items) {
+    bool indexed = this->neighbor_index != nullptr;
     
-    for (int i = 0; i < num_output_nodes; i++) {
-        char* output_name = this->session->GetOutputName(i, allocator);
-        output_node_names[i] = output_name;
+    this->inserted_items.clear();
+    
+    for (const std::pair<int, std::vector<float>> &item : items) {
+        this->inserted_items.push_back(item.first);
     }
     
-    std::vector<Ort::Value> output_tensors = this->session->Run(Ort::RunOptions{}, input_node_names.data(), ort_inputs.data(), ort_inputs.size(), output_node_names.data(), output_node_names.size());
-    float* output = output_tensors.front().GetTensorMutableData<float>();
-    float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
-    std::vector<float> sentence_emdedding(output, output + this->hidden_size);
+    this->embeddings.insert_rows(this->inserted_items);
+    insert_at_positions(this->zero_embeddings, this->inserted_items, false);
+    
+    for (const std::pair<int, std::vector<float>> &item : items) {
+        this->store_embedding(item.first, item.second);
+        
+        // Inserted by increasing position, every item lands at its own.
+        if (indexed) {
+            this->neighbor_index->insert(item.first, this->embeddings.row(item.first));
+        }
+    }
+    
+    if (!indexed && this->neighbor_m > 0 && this->embeddings.size() >= Clustering::min_indexed_items) {
+        this->build_neighbor_index();
+    }
     
-    return std::tuple<std::vector<float>, float>(sentence_emdedding, ms / 1000000);
+    this->insert_similarities(this->inserted_items);
 }
 
-Tokenizer::Tokenizer(std::string tokenizer_path, uint16_t max_seq_length) {
-    std::string str_tokenizer_model_path(tokenizer_path);
+// Rebuild the whole similarity matrix from scratch, as a single blocked product of the normalized
+// embeddings with their transpose. Null embeddings are stored as zeros so their similarities are 0.
+void Clustering::cosine_similarity_matrix() {
+    this->similarities.compute(this->embeddings);
+    this->build_dendrogram();
+}
 
-    const auto status = this->tokenizer.Load(str_tokenizer_model_path);
-    
-    if (!status.ok()) {
-        std::cerr << status.ToString() << std::endl;
+// The dendrogram is only kept under the connected components strategy, whose clusters it gives at
+// any threshold: built with the similarities, then updated on every add and remove.
+void Clustering::build_dendrogram() {
+    if (this->strategy == CONNECTED_COMPONENTS_CLUSTERING) {
+        this->dendrogram.build(this->similarities, this->zero_embeddings);
+        this->dendrogram_valid = true;
+    } else {
+        this->dendrogram = Dendrogram();
+        this->dendrogram_valid = false;
     }
-    
-    this->max_seq_length = max_seq_length;
 }
 
-std::tuple<std::vector<int32_t>, float> Tokenizer::tokenize(std::string content) {
-    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+// Splice the similarities of the embeddings freshly inserted at positions into the existing matrix,
+// only their rows are computed, as a single block product with every embedding.
+void Clustering::insert_cosine_similarities(const std::vector<size_t> &positions) {
+    this->similarities.insert(positions);
     
-    if (!this->tokenizer.status().ok()) {
-        float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    // The sparse graph only keeps the similarities above its floor, the HNSW index finds them
+    // without scanning every item.
+    if (this->neighbor_index && this->similarities.get_storage() == SPARSE_SIMILARITIES && this->similarities.get_floor() > 0) {
+        for (const size_t idx : positions) {
+            this->similarities.set(idx, idx, this->cosine_similarity(idx, idx));
+            
+            if (!this->zero_embeddings[idx]) {
+                for (const SimilarityEdge &edge : this->neighbor_index->search(this->embeddings.row(idx), this->similarities.get_floor())) {
+                    if (edge.item != idx && !this->zero_embeddings[edge.item]) {
+                        this->similarities.set(idx, edge.item, edge.similarity);
+                    }
+                }
+            }
+        }
         
-        return std::tuple<std::vector<int32_t>, float>(std::vector<int32_t>(), ms / 1000000);
+        return;
     }
     
-    std::vector<int32_t> input_ids;
+    Matrix inserted(this->embeddings.columns());
+    Matrix block(this->embeddings.size());
     
-    this->tokenizer.Encode(content, &input_ids);
+    inserted.reset(positions.size(), this->embeddings.columns());
+    block.reset(positions.size(), this->embeddings.size());
     
-    std::transform(input_ids.begin(), input_ids.end(), input_ids.begin(), [](int id){return id+1;});
+    for (size_t m = 0;m < positions.size();m++) {
+        std::copy(this->embeddings.row(positions[m]), this->embeddings.row(positions[m]) + this->embeddings.row_stride(), inserted.row(m));
+    }
     
-    if (input_ids.size() > this->max_seq_length - 2) {
-        input_ids.resize(this->max_seq_length - 2);
+    assert(inserted.row_stride() == this->embeddings.row_stride());
+    kernels::cross_gram_matrix(inserted.data(), positions.size(), this->embeddings.data(), this->embeddings.size(), this->embeddings.row_stride(), this->embeddings.row_stride(), block.data(), block.row_stride());
+    
+    // The similarity of two new items is set from the first one.
+    for (size_t m = 0;m < positions.size();m++) {
+        size_t inserted_before = 0;
+        
+        for (size_t j = 0;j < this->embeddings.size();j++) {
+            if (inserted_before < m && positions[inserted_before] == j) {
+                inserted_before++;
+                continue;
+            }
+            
+            this->similarities.set(positions[m], j, block.row(m)[j]);
+        }
     }
+}
+
+// Scan the similarities of item i for the candidate cluster grown from it: the row is active when
+// one similarity is at or above the threshold, its members are the items strictly above it, or
+// every item when the whole row is at or above it. In the sparse graph the missing edges are under
+// the floor so under the threshold.
+void Clustering::scan_row(const int i) {
+    std::vector<int> &members = this->row_members[i];
+    uint32_t above = 0;
     
-    input_ids.push_back(2);
-    input_ids.push_back(0);
+    members.clear();
     
-    std::rotate(input_ids.rbegin(), input_ids.rbegin() + 1, input_ids.rend());
+    if (this->similarities.get_storage() == SPARSE_SIMILARITIES) {
+        for (const SimilarityEdge &edge : this->similarities.edges(i)) {
+            above += edge.similarity >= this->threshold;
+            
+            if (edge.similarity > this->threshold) {
+                members.push_back(edge.item);
+            }
+        }
+    } else {
+        SimilarityRow row = this->similarities[i];
+        
+        for (int j = 0;j < row.size();j++) {
+            float similarity = row[j];
+            
+            above += similarity >= this->threshold;
+            
+            if (similarity > this->threshold) {
+                members.push_back(j);
+            }
+        }
+    }
     
-    float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    if (above == this->similarities.size()) {
+        members.resize(above);
+        std::iota(members.begin(), members.end(), 0);
+    }
     
-    return std::tuple<std::vector<int32_t>, float>(input_ids, ms / 1000000);
+    this->row_above[i] = above;
 }
 
-Clustering::Clustering(const float threshold, const char* model_path, uint16_t hidden_size, const char* tokenizer_model_path, uint16_t max_seq_length) : model(model_path, hidden_size), tokenizer(tokenizer_model_path, max_seq_length) {
-    if (threshold > 0) {
-        this->threshold = threshold;
+void Clustering::scan_rows() {
+    this->row_members.resize(this->similarities.size());
+    this->row_above.resize(this->similarities.size());
+    
+    for (int i = 0;i < this->similarities.size();i++) {
+        this->scan_row(i);
     }
+    
+    this->assign_owners();
+    this->rows_valid = true;
 }
 
-inline float Clustering::norm(const std::vector<float> &vector) {
-    float sum = std::inner_product(vector.begin(), vector.end(), vector.begin(), 0.0);
+// Update the rows after the items at positions were inserted: a row only changes when one of the
+// new similarities is above the threshold, or when the row stops or starts being entirely at or
+// above it.
+void Clustering::insert_into_rows(const std::vector<size_t> &positions) {
+    uint32_t items = this->similarities.size();
+    uint32_t previous_items = items - positions.size();
+    bool rescanned = false;
     
-    return std::sqrt(sum);
+    for (std::vector<int> &members : this->row_members) {
+        for (int &member : members) {
+            member = inserted_position(positions, member);
+        }
+    }
+    
+    insert_at_positions(this->row_members, positions, std::vector<int>());
+    insert_at_positions(this->row_above, positions, uint32_t(0));
+    this->touched_rows.clear();
+    
+    for (const size_t idx : positions) {
+        this->scan_row(idx);
+        this->touched_rows.push_back(idx);
+        rescanned = rescanned || this->row_above[idx] == items;
+    }
+    
+    size_t m = 0;
+    
+    for (int j = 0;j < items;j++) {
+        if (m < positions.size() && positions[m] == j) {
+            m++;
+            continue;
+        }
+        
+        std::vector<int> &members = this->row_members[j];
+        bool was_complete = this->row_above[j] == previous_items;
+        size_t previous_members = members.size();
+        
+        for (const size_t idx : positions) {
+            float similarity = this->similarities.get(idx, j);
+            
+            this->row_above[j] += similarity >= this->threshold;
+            
+            if (similarity > this->threshold) {
+                members.push_back(idx);
+            }
+        }
+        
+        if (was_complete || this->row_above[j] == items) {
+            this->scan_row(j);
+            rescanned = true;
+        } else if (members.size() > previous_members) {
+            std::inplace_merge(members.begin(), members.begin() + previous_members, members.end());
+            this->touched_rows.push_back(j);
+        }
+    }
+    
+    for (int &owner : this->row_owners) {
+        if (owner >= 0) {
+            owner = inserted_position(positions, owner);
+        }
+    }
+    
+    insert_at_positions(this->row_owners, positions, Clustering::no_owner);
+    
+    if (rescanned) {
+        this->assign_owners();
+    } else {
+        this->update_owners();
+    }
 }
 
-inline std::vector<float> Clustering::normalize(const std::vector<float> &vector) {
-    double norm_value = this->norm(vector);
+// Same update after the item at idx was erased, erased_similarities holding its former row.
+void Clustering::erase_from_rows(const int idx) {
+    uint32_t items = this->similarities.size();
+    bool rescanned = this->row_above[idx] == items + 1;
     
-    if (norm_value > 0) {
-        std::vector<float> normalized_vector;
+    this->row_members.erase(this->row_members.begin() + idx);
+    this->row_above.erase(this->row_above.begin() + idx);
+    this->touched_rows.clear();
+    
+    for (int j = 0;j < items;j++) {
+        float similarity = this->erased_similarities[j + (j >= idx)];
+        std::vector<int> &members = this->row_members[j];
+        bool was_complete = this->row_above[j] == items + 1;
         
-        for (int i = 0; i < vector.size(); i++) {
-            normalized_vector.push_back(vector[i] / norm_value);
+        this->row_above[j] -= similarity >= this->threshold;
+        
+        if (was_complete || this->row_above[j] == items) {
+            this->scan_row(j);
+            rescanned = true;
+            continue;
         }
         
-        return normalized_vector;
+        if (similarity > this->threshold) {
+            members.erase(std::lower_bound(members.begin(), members.end(), idx));
+            this->touched_rows.push_back(j);
+        }
+        
+        for (std::vector<int>::iterator member = std::upper_bound(members.begin(), members.end(), idx);member != members.end();++member) {
+            (*member)--;
+        }
     }
     
-    return vector;
+    this->row_owners.erase(this->row_owners.begin() + idx);
+    
+    // The items of the erased row were its members, the touched rows, so they get a new candidate.
+    for (int &owner : this->row_owners) {
+        owner -= owner > idx;
+    }
+    
+    if (rescanned) {
+        this->assign_owners();
+    } else {
+        this->update_owners();
+    }
 }
 
-inline float Clustering::cosine_similarity(const std::vector<float> &vector1, const std::vector<float> &vector2) {
-    std::vector<float> vector1_norm = this->normalize(vector1);
-    std::vector<float> vector2_norm = this->normalize(vector2);
-    std::vector<float> zeros(vector1.size(), 0);
+// Keep in owner the candidate first in the greedy order between it and the row: the largest, the
+// first row on a tie, the null cluster coming after the rows of its size.
+inline void Clustering::prefer_candidate(int &owner, const int row) {
+    if (this->zero_embeddings[row] || owner == row) {
+        return;
+    }
     
-    if (vector1_norm == zeros || vector2_norm == zeros) {
-        return 0.0;
+    if (owner == Clustering::no_owner) {
+        owner = row;
+        
+        return;
     }
     
-    double vector1_norm_vector2_norm_dot_product = std::inner_product(vector1_norm.begin(), vector1_norm.end(), vector2_norm.begin(), 0.0);
-    double similarity = vector1_norm_vector2_norm_dot_product / (this->norm(vector1_norm) * this->norm(vector2_norm));
+    size_t row_size = this->row_members[row].size();
+    size_t owner_size = owner == Clustering::null_owner ? this->null_count : this->row_members[owner].size();
     
-    return similarity;
+    if (row_size > owner_size || (row_size == owner_size && (owner == Clustering::null_owner || row < owner))) {
+        owner = row;
+    }
 }
 
-void Clustering::cosine_similarity_matrix() {
-    this->similarities.clear();
+// Candidate of the item at idx. The similarities being symmetric, the rows holding it are the
+// members of its own row, or the rows strictly above the threshold with it when its row is
+// complete, and the complete rows.
+int Clustering::greedy_owner(const int idx) {
+    int owner = this->zero_embeddings[idx] ? Clustering::null_owner : Clustering::no_owner;
     
-    for (int i = 0;i < this->embeddings.size();i++) {
-        std::vector<float> current_cosine_similarities;
+    if (this->row_above[idx] == this->similarities.size()) {
+        SimilarityRow row = this->similarities[idx];
         
-        for (int j = 0;j < this->embeddings.size();j++) {
-            current_cosine_similarities.push_back(this->cosine_similarity(this->embeddings[i], this->embeddings[j]));
+        for (int j = 0;j < row.size();j++) {
+            if (row[j] > this->threshold) {
+                this->prefer_candidate(owner, j);
+            }
+        }
+    } else {
+        for (const int j : this->row_members[idx]) {
+            this->prefer_candidate(owner, j);
         }
+    }
+    
+    for (const int j : this->complete_rows) {
+        this->prefer_candidate(owner, j);
+    }
+    
+    return owner;
+}
+
+void Clustering::assign_owners() {
+    uint32_t items = this->similarities.size();
+    
+    this->complete_rows.clear();
+    this->null_count = 0;
+    this->row_owners.resize(items);
+    
+    for (int i = 0;i < items;i++) {
+        this->null_count += this->zero_embeddings[i];
         
-        this->similarities.push_back(current_cosine_similarities);
+        if (this->row_above[i] == items) {
+            this->complete_rows.push_back(i);
+        }
+    }
+    
+    for (int i = 0;i < items;i++) {
+        this->row_owners[i] = this->greedy_owner(i);
     }
 }
 
-inline std::vector<int> Clustering::argsort(const std::vector<float> &array) {
-    std::vector<int> indices_vector(array.size());
+// Find again the candidate of the items held by the touched rows, the only rows whose size changed,
+// and of every null item when the null cluster changed size. Without a complete row before or after
+// the update, the other items keep theirs.
+void Clustering::update_owners() {
+    size_t null_count = std::count(this->zero_embeddings.begin(), this->zero_embeddings.end(), true);
     
-    std::iota(indices_vector.begin(), indices_vector.end(), 0);
-    std::sort(indices_vector.begin(), indices_vector.end(),
-              [&array](int left, int right) -> bool {
-                  return array[left] > array[right];
-              });
+    for (const int row : this->touched_rows) {
+        this->stale_owners.push_back(row);
+        this->stale_owners.insert(this->stale_owners.end(), this->row_members[row].begin(), this->row_members[row].end());
+    }
     
-    return indices_vector;
+    if (null_count != this->null_count) {
+        this->null_count = null_count;
+        
+        for (int i = 0;i < this->zero_embeddings.size();i++) {
+            if (this->zero_embeddings[i]) {
+                this->stale_owners.push_back(i);
+            }
+        }
+    }
+    
+    std::sort(this->stale_owners.begin(), this->stale_owners.end());
+    this->stale_owners.erase(std::unique(this->stale_owners.begin(), this->stale_owners.end()), this->stale_owners.end());
+    
+    for (const int i : this->stale_owners) {
+        this->row_owners[i] = this->greedy_owner(i);
+    }
+    
+    this->stale_owners.clear();
+}
+
+// One candidate per active row, for a full pass over the scanned rows.
+void Clustering::greedy_candidates() {
+    for (int i = 0;i < this->similarities.size();i++) {
+        if (this->zero_embeddings[i]) {
+            this->null_members.push_back(i);
+        } else if (this->row_above[i] > 0) {
+            this->candidate_members.insert(this->candidate_members.end(), this->row_members[i].begin(), this->row_members[i].end());
+            this->candidate_offsets.push_back(this->candidate_members.size());
+        }
+    }
 }
 
-inline std::tuple<std::vector<float>, std::vector<int>> Clustering::topk(const uint16_t k, const std::vector<float> &array) {
-    std::vector<int> indices_vector = this->argsort(array);
-    std::vector<float> sorted_vector(array);
+// Union the item at idx with every other item at or above the threshold. Null embeddings are
+// kept out of the graph, they end up in the null cluster.
+void Clustering::unite_similar_items(const int idx) {
+    if (this->zero_embeddings[idx]) {
+        return;
+    }
+    
+    if (this->similarities.get_storage() == SPARSE_SIMILARITIES) {
+        for (const SimilarityEdge &edge : this->similarities.edges(idx)) {
+            if (edge.similarity >= this->threshold && edge.item != idx && !this->zero_embeddings[edge.item]) {
+                this->components.unite(idx, edge.item);
+            }
+        }
+        
+        return;
+    }
     
-    std::sort(sorted_vector.begin(), sorted_vector.end(), std::greater<double>());
+    SimilarityRow row = this->similarities[idx];
     
-    return std::tuple<std::vector<float>, std::vector<int>>({sorted_vector.begin(), sorted_vector.begin() + k}, {indices_vector.begin(), indices_vector.begin() + k});
+    for (int j = 0;j < row.size();j++) {
+        if (row[j] >= this->threshold && j != idx && !this->zero_embeddings[j]) {
+            this->components.unite(idx, j);
+        }
+    }
 }
 
-std::tuple<std::vector<std::vector<float>>, std::vector<std::vector<int>>> Clustering::topk_matrix(const uint16_t k) {
-    std::vector<std::vector<float>> values;
-    std::vector<std::vector<int>> indices;
+void Clustering::rebuild_components() {
+    this->components.reset(this->similarities.size());
     
     for (int i = 0;i < this->similarities.size();i++) {
-        std::tuple<std::vector<float>, std::vector<int>> tmp_values_indices = this->topk(k, this->similarities[i]);
+        this->unite_similar_items(i);
+    }
+    
+    this->components_threshold = this->threshold;
+    this->components_valid = true;
+}
+
+// Erase the item at idx from the components. Only the component it belonged to is rebuilt, from
+// the edges between its remaining members. Must be called before the similarities are erased.
+void Clustering::erase_from_components(const int idx) {
+    uint32_t root = this->components.find(idx);
+    std::vector<uint32_t> &members = this->component_members;
+    
+    members.clear();
+    
+    for (int i = 0;i < this->components.size();i++) {
+        if (this->components.find(i) == root) {
+            members.push_back(i);
+        }
+    }
+    
+    this->components.isolate(members);
+    
+    for (size_t k = 0;k < members.size();k++) {
+        for (size_t l = k + 1;l < members.size();l++) {
+            if (members[k] != idx && members[l] != idx && this->similarities.get(members[k], members[l]) >= this->threshold) {
+                this->components.unite(members[k], members[l]);
+            }
+        }
+    }
+    
+    this->components.erase(idx);
+}
+
+// One candidate per connected component of the graph whose edges are the similarities at or
+// above the threshold, in order of smallest member.
+void Clustering::component_candidates() {
+    if (!this->components_valid || this->components_threshold != this->threshold) {
+        this->rebuild_components();
+    }
+    
+    this->component_candidates(this->components);
+}
+
+// Same, from components computed elsewhere.
+void Clustering::component_candidates(UnionFind &components) {
+    std::vector<int> &component_ids = this->component_ids;
+    size_t component_count = 0;
+    
+    component_ids.assign(this->zero_embeddings.size(), -1);
+    
+    for (int i = 0;i < this->zero_embeddings.size();i++) {
+        if (this->zero_embeddings[i]) {
+            this->null_members.push_back(i);
+            continue;
+        }
+        
+        uint32_t root = components.find(i);
         
-        values.push_back(std::get<0>(tmp_values_indices));
-        indices.push_back(std::get<1>(tmp_values_indices));
+        if (component_ids[root] < 0) {
+            component_ids[root] = component_count++;
+            this->candidate_offsets.push_back(0);
+        }
+        
+        this->candidate_offsets[component_ids[root] + 1]++;
+    }
+    
+    for (size_t component = 0;component < component_count;component++) {
+        this->candidate_offsets[component + 1] += this->candidate_offsets[component];
     }
     
-    return std::tuple<std::vector<std::vector<float>>, std::vector<std::vector<int>>>(values, indices);
+    this->candidate_members.resize(this->candidate_offsets.back());
+    this->size_buckets.assign(this->candidate_offsets.begin(), this->candidate_offsets.end() - 1);
+    
+    for (int i = 0;i < this->zero_embeddings.size();i++) {
+        if (!this->zero_embeddings[i]) {
+            this->candidate_members[this->size_buckets[component_ids[components.find(i)]]++] = i;
+        }
+    }
 }
 
-std::tuple<std::vector<uint16_t>, std::vector<uint16_t>> Clustering::compute_clusters() {
-    std::vector<int> null_clusters;
-    std::vector<std::vector<int>> extracted_clusters;
-    std::vector<std::vector<float>> topk_values = std::get<0>(this->topk_matrix(1));
+// One candidate per cluster of the agglomerative clustering, in order of smallest member.
+void Clustering::linkage_candidates() {
+    Linkage linkage = this->strategy == AVERAGE_LINKAGE_CLUSTERING ? AVERAGE_LINKAGE : COMPLETE_LINKAGE;
+    
+    this->linkage_clustering.cluster(this->similarities, this->embeddings, this->zero_embeddings, linkage, this->threshold);
+    this->linkage_clustering.cut(this->threshold, this->cut_components);
+    this->component_candidates(this->cut_components);
+}
 
-    for (int i = 0;i < topk_values.size();i++) {
-        if (topk_values[i].back() == 0.0) {
-            null_clusters.push_back(i);
-        } else if (topk_values[i].back() >= this->threshold) {
-            std::vector<int> new_cluster;
-            std::tuple<std::vector<float>, std::vector<int>> topk_res = this->topk(this->embeddings.size(), this->similarities[i]);
-            std::vector<float> top_val_large = std::get<0>(topk_res);
-            std::vector<int> top_idx_large = std::get<1>(topk_res);
+template<typename Index>
+std::tuple<std::vector<Index>, std::vector<Index>> Clustering::compute_clusters() {
+    this->consistency_error = false;
+    this->candidate_members.clear();
+    this->candidate_offsets.assign(1, 0);
+    this->null_members.clear();
+    
+    if (this->strategy == GREEDY_CLUSTERING) {
+        return this->greedy_clusters<Index>();
+    }
+    
+    if (this->strategy == CONNECTED_COMPONENTS_CLUSTERING) {
+        this->component_candidates();
+    } else {
+        this->linkage_candidates();
+    }
+    
+    return this->extract_clusters<Index>();
+}
+
+// The greedy clusters from the candidate of every item, in O(n). The rows and the candidates are kept
+// up to date by the insertions and removals, so only a threshold or a storage change scans them all
+// again. The consistency check compares them with a full pass extracting every candidate.
+template<typename Index>
+std::tuple<std::vector<Index>, std::vector<Index>> Clustering::greedy_clusters() {
+    if (!this->rows_valid) {
+        this->scan_rows();
+    }
+    
+    uint32_t items = this->similarities.size();
+    std::vector<size_t> &owned_items = this->owned_items;
+    size_t position = 0;
+    size_t candidates = 0;
+    
+    // Items of every row, the null cluster last.
+    owned_items.assign(items + 1, 0);
+    
+    for (int i = 0;i < items;i++) {
+        if (this->row_owners[i] != Clustering::no_owner) {
+            owned_items[this->row_owners[i] == Clustering::null_owner ? items : this->row_owners[i]]++;
+        }
+    }
+    
+    // Counting sort of the candidates holding items by decreasing size, stable so that a same size
+    // keeps the row order with the null cluster last, as in extract_clusters.
+    this->size_buckets.assign(items + 1, 0);
+    
+    for (size_t candidate = 0;candidate <= items;candidate++) {
+        if (owned_items[candidate] > 0) {
+            this->size_buckets[candidate == items ? this->null_count : this->row_members[candidate].size()]++;
+            candidates++;
+        }
+    }
+    
+    for (size_t size = this->size_buckets.size();size > 0;size--) {
+        size_t count = this->size_buckets[size - 1];
+        
+        this->size_buckets[size - 1] = position;
+        position += count;
+    }
+    
+    this->candidate_order.resize(candidates);
+    
+    for (size_t candidate = 0;candidate <= items;candidate++) {
+        if (owned_items[candidate] > 0) {
+            this->candidate_order[this->size_buckets[candidate == items ? this->null_count : this->row_members[candidate].size()]++] = candidate;
+        }
+    }
+    
+    // The items fill their clusters in increasing order, like the members of the candidates.
+    std::vector<Index> unique_clusters(std::accumulate(owned_items.begin(), owned_items.end(), size_t(0)));
+    std::vector<Index> clusters_size;
+    
+    this->candidate_offsets.assign(items + 1, 0);
+    position = 0;
+    
+    for (const int candidate : this->candidate_order) {
+        this->candidate_offsets[candidate] = position;
+        position += owned_items[candidate];
+        clusters_size.push_back(owned_items[candidate]);
+    }
+    
+    for (int i = 0;i < items;i++) {
+        if (this->row_owners[i] != Clustering::no_owner) {
+            unique_clusters[this->candidate_offsets[this->row_owners[i] == Clustering::null_owner ? items : this->row_owners[i]]++] = i;
+        }
+    }
+    
+    std::tuple<std::vector<Index>, std::vector<Index>> clusters(unique_clusters, clusters_size);
+    
+    if (this->consistency_check) {
+        std::vector<std::vector<int>> incremental_members = this->row_members;
+        std::vector<uint32_t> incremental_above = this->row_above;
+        
+        this->scan_rows();
+        this->candidate_members.clear();
+        this->candidate_offsets.assign(1, 0);
+        this->null_members.clear();
+        this->greedy_candidates();
+        
+        if (incremental_members != this->row_members || incremental_above != this->row_above || this->extract_clusters<Index>() != clusters) {
+            std::cerr << "The incremental clusters differ from a full recompute." << std::endl;
             
-            if (top_val_large.back() < this->threshold) {
-                for (int j = 0;j < top_idx_large.size();j++) {
-                    if (top_val_large[j] <= this->threshold) {
-                        break;
-                    }
-                    
-                    new_cluster.push_back(top_idx_large[j]);
-                }
-            } else {
-                for (int j = 0;j < this->similarities[i].size();j++) {
-                    if (this->similarities[i][j] >= this->threshold) {
-                        new_cluster.push_back(j);
-                    }
-                }
-            }
-            extracted_clusters.push_back(new_cluster);
+            this->consistency_error = true;
         }
     }
     
-    if (null_clusters.size() > 0) {
-        extracted_clusters.push_back(null_clusters);
+    return clusters;
+}
+
+// Extract the clusters from the candidates, sorted by decreasing size, every item going to the
+// first candidate holding it.
+template<typename Index>
+std::tuple<std::vector<Index>, std::vector<Index>> Clustering::extract_clusters() {
+    if (this->null_members.size() > 0) {
+        this->candidate_members.insert(this->candidate_members.end(), this->null_members.begin(), this->null_members.end());
+        this->candidate_offsets.push_back(this->candidate_members.size());
+    }
+    
+    // Counting sort of the candidates by decreasing size. It is stable, so the candidates of a same
+    // size stay in row order with the null cluster last.
+    const std::vector<size_t> &offsets = this->candidate_offsets;
+    size_t candidates = offsets.size() - 1;
+    size_t position = 0;
+    
+    this->size_buckets.assign(this->zero_embeddings.size() + 1, 0);
+    this->candidate_order.resize(candidates);
+    
+    for (size_t candidate = 0;candidate < candidates;candidate++) {
+        this->size_buckets[offsets[candidate + 1] - offsets[candidate]]++;
+    }
+    
+    for (size_t size = this->size_buckets.size();size > 0;size--) {
+        size_t count = this->size_buckets[size - 1];
+        
+        this->size_buckets[size - 1] = position;
+        position += count;
+    }
+    
+    for (size_t candidate = 0;candidate < candidates;candidate++) {
+        this->candidate_order[this->size_buckets[offsets[candidate + 1] - offsets[candidate]]++] = candidate;
     }
     
-    std::sort(extracted_clusters.begin(), extracted_clusters.end(), [](const std::vector<int> &a, const std::vector<int> &b){ return a.size() > b.size(); });
-    std::vector<uint16_t> unique_clusters;
-    std::vector<uint16_t> clusters_size;
-    std::set<uint16_t> extracted_ids;
+    std::vector<Index> unique_clusters;
+    std::vector<Index> clusters_size;
+    
+    unique_clusters.reserve(this->zero_embeddings.size());
+    this->extracted_items.assign(this->zero_embeddings.size(), false);
 
-    for (int i = 0;i < extracted_clusters.size();i++) {
-        std::vector<int> sorted_cluster(extracted_clusters[i]);
-        std::vector<uint16_t> non_overlapped_cluster;
+    for (const int candidate : this->candidate_order) {
+        size_t cluster_start = unique_clusters.size();
         
-        std::sort(sorted_cluster.begin(), sorted_cluster.end());
+        for (size_t j = offsets[candidate];j < offsets[candidate + 1];j++) {
+            if (!this->extracted_items[this->candidate_members[j]]) {
+                unique_clusters.push_back(this->candidate_members[j]);
+                this->extracted_items[this->candidate_members[j]] = true;
+            }
+        }
+
+        if (unique_clusters.size() > cluster_start) {
+            clusters_size.push_back(unique_clusters.size() - cluster_start);
+        }
+    }
+    
+    return std::tuple<std::vector<Index>, std::vector<Index>>(unique_clusters, clusters_size);
+}
+
+// Bring the similarities and the maintained clusterings up to date with the embeddings inserted at
+// positions, sorted.
+void Clustering::insert_similarities(const std::vector<size_t> &positions) {
+    if (this->similarities.size() + positions.size() == this->embeddings.size()) {
+        this->insert_cosine_similarities(positions);
         
-        for (int j = 0;j < sorted_cluster.size();j++) {
-            std::set<uint16_t>::iterator it = extracted_ids.find(sorted_cluster[j]);
+        if (this->dendrogram_valid) {
+            this->dendrogram.insert(positions, this->similarities, this->zero_embeddings);
+        }
+        
+        if (this->components_valid) {
+            for (const size_t idx : positions) {
+                this->components.insert(idx);
+            }
             
-            if (it == extracted_ids.end()) {
-                non_overlapped_cluster.push_back(sorted_cluster[j]);
-                extracted_ids.insert(sorted_cluster[j]);
+            for (const size_t idx : positions) {
+                this->unite_similar_items(idx);
             }
         }
+        
+        if (this->rows_valid) {
+            this->insert_into_rows(positions);
+        }
+    } else {
+        this->cosine_similarity_matrix();
+        
+        this->components_valid = false;
+        this->rows_valid = false;
+    }
+}
+
+// Normalized embedding of the item at idx among the pending items too, nullptr for a null item.
+const float* Clustering::item_embedding(const int idx) {
+    int pending_before = 0;
+    
+    for (const std::pair<int, std::vector<float>> &item : this->pending_items) {
+        if (item.first == idx) {
+            return item.second.data();
+        }
+        
+        pending_before += item.first < idx;
+    }
+    
+    return this->zero_embeddings[idx - pending_before] ? nullptr : this->embeddings.row(idx - pending_before);
+}
+
+// Move the items whose cluster changed in the last tracked clustering to their new centroid, and
+// keep the clusters for the fast path.
+template<typename Index>
+void Clustering::update_centroids(const std::vector<Index> &indices, const std::vector<Index> &clusters_size) {
+    for (size_t k = 0;k < this->changes.moved_items.size();k++) {
+        const float* embedding = this->item_embedding(this->changes.moved_items[k]);
+        
+        this->centroids.assign(this->changes.moved_items[k], embedding, embedding != nullptr ? this->changes.moved_clusters[k] : CentroidIndex::no_cluster);
+    }
+    
+    this->current_indices.assign(indices.begin(), indices.end());
+    this->current_sizes.assign(clusters_size.begin(), clusters_size.end());
+}
 
-        if (non_overlapped_cluster.size() >= 1) {
-            unique_clusters.reserve(unique_clusters.size() + distance(non_overlapped_cluster.begin(), non_overlapped_cluster.end()));
-            unique_clusters.insert(unique_clusters.end(), non_overlapped_cluster.begin(), non_overlapped_cluster.end());
-            clusters_size.push_back(non_overlapped_cluster.size());
+// Fast path of the additions: an item more similar than the threshold to its nearest centroid joins
+// its cluster, one less similar to all of them starts its own, in O(k·d) for k clusters. When the
+// similarity is within the band around the threshold, the full clustering decides. The item waits
+// in the pending items for its similarities until then.
+bool Clustering::assign_to_centroid(const int idx, const std::vector<float> &embedding) {
+    if (this->centroid_band < 0 || this->current_indices.size() != this->embeddings.size() + this->pending_items.size()) {
+        return false;
+    }
+    
+    std::vector<float> normalized(embedding.begin(), embedding.begin() + this->embeddings.columns());
+    
+    this->normalize(RowView<float>(normalized.data(), normalized.size()));
+    
+    if (std::all_of(normalized.begin(), normalized.end(), [](float value){return value == 0;})) {
+        return false;
+    }
+    
+    std::tuple<uint32_t, float> nearest = this->centroids.nearest(normalized.data());
+    uint32_t nearest_id = std::get<0>(nearest);
+    float similarity = std::get<1>(nearest);
+    
+    if (nearest_id != CentroidIndex::no_cluster && std::abs(similarity - this->threshold) <= this->centroid_band) {
+        this->centroid_misses++;
+        
+        return false;
+    }
+    
+    for (uint32_t &item : this->current_indices) {
+        item += item >= idx;
+    }
+    
+    for (std::pair<int, std::vector<float>> &item : this->pending_items) {
+        item.first += item.first >= idx;
+    }
+    
+    auto position = std::find_if(this->pending_items.begin(), this->pending_items.end(), [idx](const std::pair<int, std::vector<float>> &item){ return item.first > idx; });
+    
+    this->pending_items.insert(position, std::make_pair(idx, normalized));
+    
+    const std::vector<uint32_t> &cluster_ids = this->tracker.get_cluster_ids();
+    size_t cluster = std::find(cluster_ids.begin(), cluster_ids.end(), nearest_id) - cluster_ids.begin();
+    
+    if (similarity <= this->threshold || cluster == this->current_sizes.size()) {
+        this->current_indices.push_back(idx);
+        this->current_sizes.push_back(1);
+    } else {
+        // The grown cluster goes before the clusters of its former size to keep them sorted.
+        size_t first = cluster;
+        
+        while (first > 0 && this->current_sizes[first - 1] == this->current_sizes[cluster]) {
+            first--;
         }
+        
+        size_t first_start = std::accumulate(this->current_sizes.begin(), this->current_sizes.begin() + first, size_t(0));
+        size_t cluster_start = std::accumulate(this->current_sizes.begin() + first, this->current_sizes.begin() + cluster, first_start);
+        size_t cluster_end = cluster_start + ++this->current_sizes[cluster];
+        
+        this->current_indices.insert(this->current_indices.begin() + cluster_end - 1, idx);
+        std::rotate(this->current_indices.begin() + first_start, this->current_indices.begin() + cluster_start, this->current_indices.begin() + cluster_end);
+        std::rotate(this->current_sizes.begin() + first, this->current_sizes.begin() + cluster, this->current_sizes.begin() + cluster + 1);
+    }
+    
+    this->centroid_hits++;
+    
+    return true;
+}
+
+// Give the pending items, sorted by position, their embedding and similarities at once.
+void Clustering::flush_pending_items() {
+    if (this->pending_items.empty()) {
+        return;
     }
     
-    return std::tuple<std::vector<uint16_t>, std::vector<uint16_t>>(unique_clusters, clusters_size);
+    this->insert_items(this->pending_items);
+    this->pending_items.clear();
 }
 
-int Clustering::add_textual_item(const char* text, const int idx, ClusteringResult* result) {
+template<typename Result>
+int Clustering::add_textual_item(const char* text, const int idx, Result* result) {
     std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
     std::string content(text);
+    std::vector<float> &embedding = this->staged_embedding;
     
     if (content.size() == 0) {
-        std::vector<float> zeros(this->model.hidden_size, 0);
-        
+        std::fill(embedding.begin(), embedding.end(), 0);
         result->performance_tokenizer = 0;
         result->performance_inference = 0;
-        
-        auto it_pos = this->embeddings.begin() + idx;
-        
-        this->embeddings.insert(it_pos, zeros);
     } else {
-        std::tuple<std::vector<int32_t>, float> tokenizer_output = this->tokenizer.tokenize(std::string(content));
-        std::tuple<std::vector<float>, float> inference_output = this->model.predict(std::get<0>(tokenizer_output));
+        std::tuple<std::vector<int32_t>, float> tokenizer_output = this->encoder->tokenize(content);
         
-        result->performance_tokenizer = std::get<1>(tokenizer_output);
-        result->performance_inference = std::get<1>(inference_output);
+        this->scheduler.submit(std::get<0>(tokenizer_output), embedding.data());
         
-        auto it_pos = this->embeddings.begin() + idx;
+        result->performance_tokenizer = std::get<1>(tokenizer_output);
+        result->performance_inference = this->scheduler.flush();
+    }
+    
+    this->tracker.insert(idx);
+    this->centroids.insert(idx);
+    
+    if (this->assign_to_centroid(idx, embedding)) {
+        std::vector<typename Result::index_type> unique_clusters(this->current_indices.begin(), this->current_indices.end());
+        std::vector<typename Result::index_type> clusters_size(this->current_sizes.begin(), this->current_sizes.end());
         
-        this->embeddings.insert(it_pos, std::get<0>(inference_output));
+        return this->format_clustering_result(std::make_tuple(unique_clusters, clusters_size), result, start);
     }
     
-    this->cosine_similarity_matrix();
+    this->flush_pending_items();
+    this->insert_embedding(idx, embedding);
+    this->inserted_items.assign(1, idx);
+    this->insert_similarities(this->inserted_items);
     
-    std::tuple<std::vector<uint16_t>, std::vector<uint16_t>> result_clusters = this->compute_clusters();
+    std::tuple<std::vector<typename Result::index_type>, std::vector<typename Result::index_type>> result_clusters = this->compute_clusters<typename Result::index_type>();
     
     assert(std::get<0>(result_clusters).size() == this->embeddings.size());
     
-    this->format_clustering_result(result_clusters, result, start);
-    
-    return 0;
+    return this->format_clustering_result(result_clusters, result, start);
 }
 
-int Clustering::remove_textual_item(const int idx, const int from_add, ClusteringResult* result) {
+// Add the items at once, every idx being the position of its item once all are added, with a
+// single update of the embeddings and the similarities and a single clustering. Fails without
+// adding anything when an idx is out of range or repeated.
+template<typename Result>
+int Clustering::add_textual_items(const char** texts, const int* idxs, const int count, Result* result) {
     std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
-    this->embeddings.erase(this->embeddings.begin() + idx);
+    size_t items = this->embeddings.size() + this->pending_items.size() + std::max(count, 0);
+    std::vector<int> order(std::max(count, 0));
+    bool valid = count >= 0;
     
-    for (int i = 0;i < this->similarities.size();i++) {
-        this->similarities[i].erase(this->similarities[i].begin() + idx);
-    }
+    result->performance_tokenizer = 0;
+    result->performance_inference = 0;
     
-    this->similarities.erase(this->similarities.begin() + idx);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [idxs](const int a, const int b){ return idxs[a] < idxs[b]; });
     
-    if (this->embeddings.size() > 0 && from_add == 0) {
-        std::tuple<std::vector<uint16_t>, std::vector<uint16_t>> result_clusters = this->compute_clusters();
+    for (int k = 0;k < count;k++) {
+        valid = valid && idxs[order[k]] >= 0 && idxs[order[k]] < items && (k == 0 || idxs[order[k]] != idxs[order[k - 1]]);
+    }
+    
+    if (!valid) {
+        this->format_clustering_result(std::tuple<std::vector<typename Result::index_type>, std::vector<typename Result::index_type>>(), result, start, false);
         
-        assert(std::get<0>(result_clusters).size() == this->embeddings.size());
+        return -1;
+    }
+    
+    std::vector<std::vector<int32_t>> input_ids(count);
+    std::vector<std::pair<int, std::vector<float>>> inserted(count);
+    
+    for (int i = 0;i < count;i++) {
+        std::string content(texts[i]);
         
-        result->performance_tokenizer = 0;
-        result->performance_inference = 0;
+        if (content.size() > 0) {
+            std::tuple<std::vector<int32_t>, float> tokenizer_output = this->encoder->tokenize(content);
+            
+            input_ids[i] = std::get<0>(tokenizer_output);
+            result->performance_tokenizer += std::get<1>(tokenizer_output);
+        }
+    }
+    
+    // The embeddings are written in the order of the positions.
+    for (int k = 0;k < count;k++) {
+        inserted[k].first = idxs[order[k]];
+        inserted[k].second.assign(this->encoder->get_hidden_size(), 0);
         
-        this->format_clustering_result(result_clusters, result, start);
-    } else {
-        result->cluster = new ClusterDefinition();
-        result->cluster->indices = new uint16_t[0];
-        result->cluster->clusters_split = new uint16_t[0];
+        if (input_ids[order[k]].size() > 0) {
+            this->scheduler.submit(input_ids[order[k]], inserted[k].second.data());
+        }
     }
     
-    return 0;
+    result->performance_inference = this->scheduler.flush();
+    
+    this->flush_pending_items();
+    
+    for (const std::pair<int, std::vector<float>> &item : inserted) {
+        this->tracker.insert(item.first);
+        this->centroids.insert(item.first);
+    }
+    
+    if (count > 0) {
+        this->insert_items(inserted);
+    }
+    
+    std::tuple<std::vector<typename Result::index_type>, std::vector<typename Result::index_type>> result_clusters = this->compute_clusters<typename Result::index_type>();
+    
+    assert(std::get<0>(result_clusters).size() == this->embeddings.size());
+    
+    return this->format_clustering_result(result_clusters, result, start);
 }
 
-// Turn the C++ results into a Swift understandable structure.
-void Clustering::format_clustering_result(std::tuple<std::vector<uint16_t>, std::vector<uint16_t>> result_clusters, ClusteringResult* result, std::chrono::high_resolution_clock::time_point start) {
-    std::vector<uint16_t> unique_clusters = std::get<0>(result_clusters);
-    std::vector<uint16_t> clusters_size = std::get<1>(result_clusters);
-    std::vector<float> single_d_similarities;
+template<typename Result>
+int Clustering::remove_textual_item(const int idx, const int from_add, Result* result) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
     
-    for (auto sim : this->similarities) {
-        single_d_similarities.reserve(single_d_similarities.size() + distance(sim.begin(), sim.end()));
-        single_d_similarities.insert(single_d_similarities.end(), sim.begin(), sim.end());
+    this->flush_pending_items();
+    this->centroids.erase(idx, this->embeddings.row(idx));
+    this->embeddings.erase_row(idx);
+    this->zero_embeddings.erase(this->zero_embeddings.begin() + idx);
+    this->tracker.erase(idx);
+    
+    if (this->neighbor_index) {
+        this->neighbor_index->erase(idx);
     }
     
-    result->cluster = new ClusterDefinition();
-    result->cluster->indices = new uint16_t[unique_clusters.size()];
-    result->cluster->clusters_split = new uint16_t[clusters_size.size()];
+    if (this->components_valid) {
+        this->erase_from_components(idx);
+    }
     
-    std::memcpy(result->cluster->indices, unique_clusters.data(), sizeof(uint16_t) * unique_clusters.size());
-    std::memcpy(result->cluster->clusters_split, clusters_size.data(), sizeof(uint16_t) * clusters_size.size());
+    if (this->rows_valid) {
+        this->erased_similarities.assign(this->similarities[idx].begin(), this->similarities[idx].end());
+    }
+    
+    if (this->dendrogram_valid) {
+        this->dendrogram.erase(idx, this->similarities);
+    }
+    
+    this->similarities.erase(idx);
+    
+    if (this->rows_valid) {
+        this->erase_from_rows(idx);
+    }
+    
+    result->performance_tokenizer = 0;
+    result->performance_inference = 0;
+    
+    // When the removal is the first half of an update, the following add returns the clusters.
+    if (from_add != 0) {
+        return this->format_clustering_result(std::tuple<std::vector<typename Result::index_type>, std::vector<typename Result::index_type>>(), result, start, false);
+    }
+    
+    std::tuple<std::vector<typename Result::index_type>, std::vector<typename Result::index_type>> result_clusters = this->compute_clusters<typename Result::index_type>();
+    
+    assert(std::get<0>(result_clusters).size() == this->embeddings.size());
+    
+    return this->format_clustering_result(result_clusters, result, start);
+}
+
+template<typename T>
+static T* copy_to_array(const std::vector<T> &values) {
+    T* array = new T[values.size()];
+    
+    std::copy(values.begin(), values.end(), array);
+    
+    return array;
+}
+
+// Turn the C++ results into a Swift understandable structure. Fails when the items cannot be
+// encoded in the index width of the result ABI, the clustering itself stays up to date. Without
+// complete clusters, the result is left empty. Untracked clusters are not the current clustering
+// and leave the cluster ids as they are.
+template<typename Index>
+int Clustering::format_clustering_result(std::tuple<std::vector<Index>, std::vector<Index>> result_clusters, BasicClusteringResult<Index>* result, std::chrono::high_resolution_clock::time_point start, const bool complete, const bool tracked) {
+    std::vector<Index> unique_clusters = std::get<0>(result_clusters);
+    std::vector<Index> clusters_size = std::get<1>(result_clusters);
+    
+    if (!complete) {
+        result->cluster = new BasicClusterDefinition<Index>();
+        result->cluster->indices = new Index[0];
+        result->cluster->clusters_split = new Index[0];
+        
+        return 0;
+    }
+    
+    size_t items = this->embeddings.size() + this->pending_items.size();
+    
+    if (items > std::numeric_limits<Index>::max()) {
+        std::cerr << "Cannot encode the clusters of " << items << " items on " << 8 * sizeof(Index) << " bits, use the V2 result ABI." << std::endl;
+        
+        unique_clusters.clear();
+        clusters_size.clear();
+        this->current_indices.clear();
+        this->current_sizes.clear();
+    } else if (tracked) {
+        this->tracker.update(unique_clusters, clusters_size, this->changes);
+        this->update_centroids(unique_clusters, clusters_size);
+    }
+    
+    result->cluster = new BasicClusterDefinition<Index>();
+    result->cluster->indices = new Index[unique_clusters.size()];
+    result->cluster->clusters_split = new Index[clusters_size.size()];
+    
+    std::memcpy(result->cluster->indices, unique_clusters.data(), sizeof(Index) * unique_clusters.size());
+    std::memcpy(result->cluster->clusters_split, clusters_size.data(), sizeof(Index) * clusters_size.size());
     
     result->cluster->indices_size = unique_clusters.size();
     result->cluster->clusters_split_size = clusters_size.size();
@@ -342,71 +1077,257 @@ void Clustering::format_clustering_result(std::tuple<std::vector<uint16_t>, std:
     float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
     
     result->performance_clustering = ms / 1000000;
+    
+    return unique_clusters.size() == items && !this->consistency_error ? 0 : -1;
 }
 
-// Compute the optimal threshold for a given cluster.
-int Clustering::recompute_clustering_threshold(const ClusterDefinition* expected_clusters, ClusteringResult* result) {
-    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
-    std::vector<uint16_t> converted_expected_clusters;
+// Same as above, encoding only what changed since the previous clustering.
+int Clustering::format_clustering_result(std::tuple<std::vector<uint32_t>, std::vector<uint32_t>> result_clusters, ClusteringDeltaResult* result, std::chrono::high_resolution_clock::time_point start, const bool complete) {
+    result->delta = new ClusteringDelta();
     
-    for (int i = 0;i < expected_clusters->clusters_split_size;i++) {
-        std::vector<uint16_t> cluster (expected_clusters->clusters_split[i], i);
-        
-        converted_expected_clusters.reserve(converted_expected_clusters.size() + distance(cluster.begin(), cluster.end()));
-        converted_expected_clusters.insert(converted_expected_clusters.end(), cluster.begin(), cluster.end());
+    if (complete) {
+        this->tracker.update(std::get<0>(result_clusters), std::get<1>(result_clusters), this->changes);
+        this->update_centroids(std::get<0>(result_clusters), std::get<1>(result_clusters));
+    } else {
+        this->changes = ClusterChanges();
+        this->changes.version = this->tracker.get_version();
     }
     
-    std::tuple<std::vector<uint16_t>, std::vector<uint16_t>> best_clusters;
-    float best_acc = 0.0;
-    float best_threshold = 0.0;
+    result->delta->version = this->changes.version;
+    result->delta->moved_items = copy_to_array(this->changes.moved_items);
+    result->delta->moved_clusters = copy_to_array(this->changes.moved_clusters);
+    result->delta->moved_size = this->changes.moved_items.size();
+    result->delta->created_clusters = copy_to_array(this->changes.created_clusters);
+    result->delta->created_size = this->changes.created_clusters.size();
+    result->delta->removed_clusters = copy_to_array(this->changes.removed_clusters);
+    result->delta->removed_size = this->changes.removed_clusters.size();
+    result->delta->merged_from = copy_to_array(this->changes.merged_from);
+    result->delta->merged_into = copy_to_array(this->changes.merged_into);
+    result->delta->merged_size = this->changes.merged_from.size();
+    result->delta->split_from = copy_to_array(this->changes.split_from);
+    result->delta->split_into = copy_to_array(this->changes.split_into);
+    result->delta->split_size = this->changes.split_from.size();
+    
+    float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    
+    result->performance_clustering = ms / 1000000;
+    
+    return !this->consistency_error ? 0 : -1;
+}
+
+// Compute the optimal threshold for a given cluster.
+template<typename Index>
+int Clustering::recompute_clustering_threshold(const BasicClusterDefinition<Index>* expected_clusters, BasicClusteringResult<Index>* result) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    std::vector<uint32_t> expected_size(expected_clusters->clusters_split, expected_clusters->clusters_split + expected_clusters->clusters_split_size);
+    
+    this->flush_pending_items();
     
     result->performance_tokenizer = 0;
     result->performance_inference = 0;
     
-    for (float i = 0.0001;i < 1.0;i+=0.0001) {
-        this->threshold = i;
-        
-        std::tuple<std::vector<uint16_t>, std::vector<uint16_t>> result_clusters = this->compute_clusters();
-        
-        assert(std::get<0>(result_clusters).size() == this->similarities.size());
-        
-        std::vector<uint16_t> new_clusters;
-        
-        for (int j = 0;j < std::get<1>(result_clusters).size();j++) {
-            std::vector<uint16_t> cluster (std::get<1>(result_clusters)[j], j);
-            new_clusters.reserve(new_clusters.size() + distance(cluster.begin(), cluster.end()));
-            new_clusters.insert(new_clusters.end(), cluster.begin(), cluster.end());
-        }
-        
-        int diff = 0;
+    // The sparse graph cannot answer for a threshold under its floor.
+    float floor = 0;
+    
+    if (this->similarities.get_storage() == SPARSE_SIMILARITIES) {
+        floor = this->similarities.get_floor();
+    }
+    
+    std::tuple<float, float> best;
+    
+    // The clusters of the linkage strategies at every threshold are the components of their merges.
+    if (this->strategy == AVERAGE_LINKAGE_CLUSTERING || this->strategy == COMPLETE_LINKAGE_CLUSTERING) {
+        this->linkage_clustering.cluster(this->similarities, this->embeddings, this->zero_embeddings, this->strategy == AVERAGE_LINKAGE_CLUSTERING ? AVERAGE_LINKAGE : COMPLETE_LINKAGE, floor);
         
-        for (int j = 0;j < new_clusters.size();j++) {
-            if (new_clusters.at(j) != converted_expected_clusters.at(j)) {
-                diff++;
-            }
-        }
+        ThresholdSweep sweep(this->linkage_clustering.get_merges(), this->zero_embeddings, floor, this->calibration_threads);
         
-        float acc = (new_clusters.size() - diff) / float(new_clusters.size());
+        best = sweep.connected_components(expected_size);
+    } else {
+        ThresholdSweep sweep(this->similarities, this->zero_embeddings, floor, this->calibration_threads);
         
-        if (acc == 1) {
-            best_clusters = result_clusters;
-            
-            break;
-        } else {
-            if (acc > best_acc) {
-                best_threshold = i;
-                best_acc = acc;
-                best_clusters = result_clusters;
-            }
-        }
+        best = this->strategy == CONNECTED_COMPONENTS_CLUSTERING ? sweep.connected_components(expected_size) : sweep.greedy(expected_size);
     }
     
+    float best_threshold = std::max(std::get<0>(best), floor);
+    
     this->threshold = best_threshold;
-    this->format_clustering_result(best_clusters, result, start);
+    this->rows_valid = false;
     
-    return 0;
+    std::tuple<std::vector<Index>, std::vector<Index>> result_clusters = this->compute_clusters<Index>();
+    
+    return this->format_clustering_result(result_clusters, result, start);
+}
+
+// Single-linkage clusters at a threshold, cut from the dendrogram without reading the similarities
+// nor changing the threshold. They are the clusters of the connected components strategy, the only
+// one keeping the dendrogram.
+template<typename Index>
+int Clustering::clusters_at_threshold(const float threshold, BasicClusteringResult<Index>* result) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    result->performance_tokenizer = 0;
+    result->performance_inference = 0;
+    
+    // Under the floor, the sparse graph misses similarities the cut needs.
+    if (this->strategy != CONNECTED_COMPONENTS_CLUSTERING || (this->similarities.get_storage() == SPARSE_SIMILARITIES && threshold < this->similarities.get_floor())) {
+        this->format_clustering_result(std::tuple<std::vector<Index>, std::vector<Index>>(), result, start, false);
+        
+        return -1;
+    }
+    
+    // The items added from the centroids join the dendrogram with their similarities.
+    this->flush_pending_items();
+    this->consistency_error = false;
+    this->candidate_members.clear();
+    this->candidate_offsets.assign(1, 0);
+    this->null_members.clear();
+    this->dendrogram.cut(threshold, this->cut_components);
+    this->component_candidates(this->cut_components);
+    
+    std::tuple<std::vector<Index>, std::vector<Index>> result_clusters = this->extract_clusters<Index>();
+    
+    return this->format_clustering_result(result_clusters, result, start, true, false);
 }
 
 float Clustering::get_threshold() {
     return this->threshold;
 }
+
+// The sparse graph keeps its floor at or under the threshold like set_sparse_similarity_floor
+// requires, so a threshold calibrated under the floor lowers it. The linkage strategies reject it.
+int Clustering::set_similarity_storage(const SimilarityStorage storage) {
+    if (storage != DENSE_SIMILARITIES && storage != PACKED_SIMILARITIES && storage != SPARSE_SIMILARITIES) {
+        return -1;
+    }
+    
+    if (storage == SPARSE_SIMILARITIES && (this->strategy == AVERAGE_LINKAGE_CLUSTERING || this->strategy == COMPLETE_LINKAGE_CLUSTERING)) {
+        return -1;
+    }
+    
+    this->similarities.set_storage(storage, std::min(this->similarities.get_floor(), this->threshold), this->embeddings);
+    this->build_dendrogram();
+    this->components_valid = false;
+    this->rows_valid = false;
+    
+    return 0;
+}
+
+void Clustering::build_neighbor_index() {
+    this->neighbor_index = std::make_unique<HnswIndex>(this->embeddings.columns(), this->neighbor_m, this->neighbor_ef_construction, this->neighbor_ef_search);
+    
+    for (int i = 0;i < this->embeddings.size();i++) {
+        this->neighbor_index->insert(i, this->embeddings.row(i));
+    }
+}
+
+// Find the neighbors of the inserted items in the sparse storage with an HNSW index, m = 0 drops it.
+// The index is approximate: an edge it misses is missing from the graph, so the clusters can differ
+// from the exact sparse ones until the next full rebuild of the similarities. It is only built from
+// min_indexed_items items, where it gets faster than an exact row.
+int Clustering::set_neighbor_index(const uint16_t m, const uint16_t ef_construction, const uint16_t ef_search) {
+    this->neighbor_index.reset();
+    this->neighbor_m = m;
+    this->neighbor_ef_construction = ef_construction;
+    this->neighbor_ef_search = ef_search;
+    
+    if (m > 0 && this->embeddings.size() >= Clustering::min_indexed_items) {
+        this->build_neighbor_index();
+    }
+    
+    return 0;
+}
+
+// Number of threads sweeping the thresholds in recompute_clustering_threshold, 0 for one per core.
+int Clustering::set_calibration_threads(const uint16_t threads) {
+    this->calibration_threads = threads > 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+    
+    return 0;
+}
+
+// Add the items from the centroids of the clusters unless their similarity with the nearest one is
+// within the band around the threshold, a negative band adds every item with the full clustering.
+int Clustering::set_centroid_fast_path(const float band) {
+    this->centroid_band = band;
+    
+    return 0;
+}
+
+// Additions decided by the centroids and additions whose nearest centroid fell within the band.
+std::tuple<uint64_t, uint64_t> Clustering::get_centroid_fast_path_stats() {
+    return std::make_tuple(this->centroid_hits, this->centroid_misses);
+}
+
+// Buckets of the sequence lengths batched together and token budget of a batch.
+int Clustering::set_inference_scheduling(const std::vector<uint16_t> &boundaries, const uint32_t max_batch_tokens) {
+    return this->scheduler.configure(boundaries, max_batch_tokens);
+}
+
+InferenceStats Clustering::get_inference_stats() {
+    InferenceStats stats = this->scheduler.get_stats();
+    
+    stats.allocations += this->encoder->get_allocations();
+    
+    return stats;
+}
+
+// Output of the model fetched as the embeddings, such as a pooled output, the first one by default.
+int Clustering::set_model_output(const char* name) {
+    return this->encoder->set_output(std::string(name));
+}
+
+// The linkage strategies update the similarities in place, which the sparse storage cannot hold.
+int Clustering::set_clustering_strategy(const ClusteringStrategy strategy) {
+    if (strategy != GREEDY_CLUSTERING && strategy != CONNECTED_COMPONENTS_CLUSTERING && strategy != AVERAGE_LINKAGE_CLUSTERING && strategy != COMPLETE_LINKAGE_CLUSTERING) {
+        return -1;
+    }
+    
+    if ((strategy == AVERAGE_LINKAGE_CLUSTERING || strategy == COMPLETE_LINKAGE_CLUSTERING) && this->similarities.get_storage() == SPARSE_SIMILARITIES) {
+        return -1;
+    }
+    
+    this->strategy = strategy;
+    this->components_valid = false;
+    this->rows_valid = false;
+    this->current_indices.clear();
+    this->current_sizes.clear();
+    this->build_dendrogram();
+    
+    return 0;
+}
+
+// Compare the incrementally maintained clusters with a full recompute on every clustering, the
+// results of the full recompute are kept and the call fails on a difference.
+int Clustering::set_consistency_check(const bool enabled) {
+    this->consistency_check = enabled;
+    
+    return 0;
+}
+
+// Similarities under the floor are dropped from the sparse graph, it must stay at or under the
+// threshold for the clusters to be unchanged.
+int Clustering::set_sparse_similarity_floor(const float floor) {
+    if (floor > this->threshold) {
+        return -1;
+    }
+    
+    this->similarities.set_storage(this->similarities.get_storage(), floor, this->embeddings);
+    this->build_dendrogram();
+    this->components_valid = false;
+    this->rows_valid = false;
+    
+    return 0;
+}
+
+template int Clustering::add_textual_item<ClusteringResult>(const char* text, const int idx, ClusteringResult* result);
+template int Clustering::add_textual_item<ClusteringResultV2>(const char* text, const int idx, ClusteringResultV2* result);
+template int Clustering::add_textual_item<ClusteringDeltaResult>(const char* text, const int idx, ClusteringDeltaResult* result);
+template int Clustering::add_textual_items<ClusteringResult>(const char** texts, const int* idxs, const int count, ClusteringResult* result);
+template int Clustering::add_textual_items<ClusteringResultV2>(const char** texts, const int* idxs, const int count, ClusteringResultV2* result);
+template int Clustering::add_textual_items<ClusteringDeltaResult>(const char** texts, const int* idxs, const int count, ClusteringDeltaResult* result);
+template int Clustering::remove_textual_item<ClusteringResult>(const int idx, const int from_add, ClusteringResult* result);
+template int Clustering::remove_textual_item<ClusteringResultV2>(const int idx, const int from_add, ClusteringResultV2* result);
+template int Clustering::remove_textual_item<ClusteringDeltaResult>(const int idx, const int from_add, ClusteringDeltaResult* result);
+template int Clustering::recompute_clustering_threshold<uint16_t>(const ClusterDefinition* clusters, ClusteringResult* result);
+template int Clustering::recompute_clustering_threshold<uint32_t>(const ClusterDefinitionV2* clusters, ClusteringResultV2* result);
+template int Clustering::clusters_at_threshold<uint16_t>(const float threshold, ClusteringResult* result);
+template int Clustering::clusters_at_threshold<uint32_t>(const float threshold, ClusteringResultV2* result);
@@ -7,9 +7,20 @@
 #ifndef clustering_hpp
 #define clustering_hpp
 
-#include "sentencepiece_processor.hpp"
-#include "onnxruntime_cxx_api.h"
+#include "text_encoder.hpp"
+#include "matrix.hpp"
+#include "kernels.hpp"
+#include "similarity_matrix.hpp"
+#include "hnsw_index.hpp"
+#include "union_find.hpp"
+#include "cluster_tracker.hpp"
+#include "threshold_sweep.hpp"
+#include "dendrogram.hpp"
+#include "linkage_clustering.hpp"
+#include "centroid_index.hpp"
+#include "inference_scheduler.hpp"
 #include <iostream>
+#include <memory>
 #include <chrono>
 #include <algorithm>
 #include <vector>
@@ -18,64 +29,209 @@
 #include <set>
 #include <iomanip>
 #include <cassert>
+#include <limits>
+#include <thread>
 
-struct ClusterDefinition {
-    uint16_t* indices;
-    uint16_t indices_size;
-    uint16_t* clusters_split;
-    uint16_t clusters_split_size;
+// The width of Index is the result ABI: 16 bits for the original functions of c_wrapper.hpp and 32
+// bits for their V2 versions, so that the small stores keep the compact encoding.
+template<typename Index>
+struct BasicClusterDefinition {
+    Index* indices;
+    Index indices_size;
+    Index* clusters_split;
+    Index clusters_split_size;
 };
 
-struct ClusteringResult {
-    ClusterDefinition* cluster;
+template<typename Index>
+struct BasicClusteringResult {
+    typedef Index index_type;
+    
+    BasicClusterDefinition<Index>* cluster;
     float performance_tokenizer;
     float performance_inference;
     float performance_clustering;
 };
 
-class Tokenizer {
-    private:
-        sentencepiece::SentencePieceProcessor tokenizer;
-        uint16_t max_seq_length;
-    public:
-        Tokenizer(std::string tokenizer_model_path, uint16_t max_seq_length);
-        std::tuple<std::vector<int32_t>, float> tokenize(std::string text);
+typedef BasicClusterDefinition<uint16_t> ClusterDefinition;
+typedef BasicClusteringResult<uint16_t> ClusteringResult;
+typedef BasicClusterDefinition<uint32_t> ClusterDefinitionV2;
+typedef BasicClusteringResult<uint32_t> ClusteringResultV2;
+
+// What changed since the previous clustering, with the stable ids of ClusterTracker. Pairs of
+// arrays share their size: item moved_items[i] now belongs to moved_clusters[i].
+struct ClusteringDelta {
+    uint64_t version;
+    uint32_t* moved_items;
+    uint32_t* moved_clusters;
+    uint32_t moved_size;
+    uint32_t* created_clusters;
+    uint32_t created_size;
+    uint32_t* removed_clusters;
+    uint32_t removed_size;
+    uint32_t* merged_from;
+    uint32_t* merged_into;
+    uint32_t merged_size;
+    uint32_t* split_from;
+    uint32_t* split_into;
+    uint32_t split_size;
 };
 
-class Model {
-    private:
-        std::unique_ptr<Ort::Session> session;
-        std::unique_ptr<Ort::Env> env;
-    public:
-        uint16_t hidden_size;
+struct ClusteringDeltaResult {
+    typedef uint32_t index_type;
     
-        Model(std::string model_path, uint16_t hidden_size);
-        std::tuple<std::vector<float>, float> predict(std::vector<int32_t> input_ids);
+    ClusteringDelta* delta;
+    float performance_tokenizer;
+    float performance_inference;
+    float performance_clustering;
+};
+
+enum ClusteringStrategy {
+    // One cluster grown from every item above the threshold, largest first, each item kept in the
+    // first cluster it appears in.
+    GREEDY_CLUSTERING = 0,
+    // Connected components of the graph linking the items at or above the threshold.
+    CONNECTED_COMPONENTS_CLUSTERING = 1,
+    // Agglomerative clustering merging the clusters while their mean similarity is at or above the
+    // threshold.
+    AVERAGE_LINKAGE_CLUSTERING = 2,
+    // Same, with the lowest similarity between the items of two clusters.
+    COMPLETE_LINKAGE_CLUSTERING = 3
 };
 
 class Clustering {
     private:
-        std::vector<std::vector<float>> similarities;
-        std::vector<std::vector<float>> embeddings;
+        std::unique_ptr<TextEncoder> encoder;
+        SimilarityMatrix similarities;
+        Matrix embeddings;
+        std::vector<bool> zero_embeddings;
+        // Below this many items an exact row is faster to compute than an HNSW search, see
+        // Benchmarks/hnsw_benchmark.cpp.
+        static constexpr size_t min_indexed_items = 10000;
+        
+        std::unique_ptr<HnswIndex> neighbor_index;
+        uint16_t neighbor_m = 0;
+        uint16_t neighbor_ef_construction = 0;
+        uint16_t neighbor_ef_search = 0;
+        std::vector<int> candidate_members;
+        std::vector<size_t> candidate_offsets;
+        std::vector<int> candidate_order;
+        std::vector<int> null_members;
+        std::vector<size_t> size_buckets;
+        std::vector<bool> extracted_items;
+        ClusteringStrategy strategy = GREEDY_CLUSTERING;
+        UnionFind components;
+        bool components_valid = false;
+        float components_threshold = 0;
+        std::vector<uint32_t> component_members;
+        std::vector<int> component_ids;
+        Dendrogram dendrogram;
+        bool dendrogram_valid = false;
+        LinkageClustering linkage_clustering;
+        UnionFind cut_components;
+        std::vector<std::vector<int>> row_members;
+        std::vector<uint32_t> row_above;
+        std::vector<float> erased_similarities;
+        bool rows_valid = false;
+        // Greedy candidate of every item: the row first in the greedy order among the ones holding
+        // it, null_owner for the null cluster and no_owner when none holds it. Kept with the rows,
+        // only the items of the rows whose members changed are looked at again.
+        static constexpr int null_owner = -1;
+        static constexpr int no_owner = -2;
+        std::vector<int> row_owners;
+        std::vector<int> touched_rows;
+        std::vector<int> complete_rows;
+        std::vector<int> stale_owners;
+        std::vector<size_t> owned_items;
+        size_t null_count = 0;
+        ClusterTracker tracker;
+        ClusterChanges changes;
+        CentroidIndex centroids;
+        // Last tracked clusters, encoded as in the results.
+        std::vector<uint32_t> current_indices;
+        std::vector<uint32_t> current_sizes;
+        // Items added from the centroids alone, by position with their normalized embedding, out of
+        // the embeddings and the similarities until the next full clustering.
+        std::vector<std::pair<int, std::vector<float>>> pending_items;
+        // Negative when the centroids fast path is disabled.
+        float centroid_band = -1;
+        uint64_t centroid_hits = 0;
+        uint64_t centroid_misses = 0;
+        bool consistency_check = false;
+        bool consistency_error = false;
+        uint16_t calibration_threads = std::max(std::thread::hardware_concurrency(), 1u);
         float threshold = 0.4659;
-        Model model;
-        Tokenizer tokenizer;
+        InferenceScheduler scheduler;
+        // Embedding written by the inference of a single item, until it is normalized into the
+        // embeddings or the pending items.
+        std::vector<float> staged_embedding;
+        // Positions of the items being inserted, sorted.
+        std::vector<size_t> inserted_items;
         
-        std::tuple<std::vector<uint16_t>, std::vector<uint16_t>> compute_clusters();
-        void format_clustering_result(std::tuple<std::vector<uint16_t>, std::vector<uint16_t>> expected_clusters, ClusteringResult* result, std::chrono::high_resolution_clock::time_point start);
-        inline float norm(const std::vector<float> &vector);
-        inline std::vector<float> normalize(const std::vector<float> &vector);
-        inline float cosine_similarity(const std::vector<float> &vector1, const std::vector<float> &vector2);
+        template<typename Index>
+        std::tuple<std::vector<Index>, std::vector<Index>> compute_clusters();
+        template<typename Index>
+        std::tuple<std::vector<Index>, std::vector<Index>> extract_clusters();
+        template<typename Index>
+        int format_clustering_result(std::tuple<std::vector<Index>, std::vector<Index>> expected_clusters, BasicClusteringResult<Index>* result, std::chrono::high_resolution_clock::time_point start, const bool complete = true, const bool tracked = true);
+        int format_clustering_result(std::tuple<std::vector<uint32_t>, std::vector<uint32_t>> expected_clusters, ClusteringDeltaResult* result, std::chrono::high_resolution_clock::time_point start, const bool complete = true);
+        inline float norm(const RowView<const float> vector);
+        inline void normalize(const RowView<float> vector);
+        inline float cosine_similarity(const int i, const int j);
+        void store_embedding(const int idx, const std::vector<float> &embedding);
+        void insert_embedding(const int idx, const std::vector<float> &embedding);
+        void insert_items(const std::vector<std::pair<int, std::vector<float>>> &items);
+        void build_neighbor_index();
+        void insert_similarities(const std::vector<size_t> &positions);
+        const float* item_embedding(const int idx);
+        template<typename Index>
+        void update_centroids(const std::vector<Index> &indices, const std::vector<Index> &clusters_size);
+        bool assign_to_centroid(const int idx, const std::vector<float> &embedding);
+        void flush_pending_items();
         void cosine_similarity_matrix();
-        inline std::vector<int> argsort(const std::vector<float> &array);
-        std::tuple<std::vector<std::vector<float>>, std::vector<std::vector<int>>> topk_matrix(const uint16_t k);
-        inline std::tuple<std::vector<float>, std::vector<int>> topk(const uint16_t k, const std::vector<float> &array);
+        void build_dendrogram();
+        void insert_cosine_similarities(const std::vector<size_t> &positions);
+        void scan_row(const int i);
+        void scan_rows();
+        void insert_into_rows(const std::vector<size_t> &positions);
+        void erase_from_rows(const int idx);
+        inline void prefer_candidate(int &owner, const int row);
+        int greedy_owner(const int idx);
+        void assign_owners();
+        void update_owners();
+        void greedy_candidates();
+        template<typename Index>
+        std::tuple<std::vector<Index>, std::vector<Index>> greedy_clusters();
+        void unite_similar_items(const int idx);
+        void rebuild_components();
+        void erase_from_components(const int idx);
+        void component_candidates();
+        void component_candidates(UnionFind &components);
+        void linkage_candidates();
     public:
-        Clustering(const float threshold, const char* model_path, uint16_t hidden_size, const char* tokenizer_model_path, uint16_t max_seq_length);
+        Clustering(const float threshold, std::unique_ptr<TextEncoder> encoder);
         float get_threshold();
-        int add_textual_item(const char* text, const int idx, ClusteringResult* result);
-        int remove_textual_item(const int idx, const int from_add, ClusteringResult* result);
-        int recompute_clustering_threshold(const ClusterDefinition* clusters, ClusteringResult* result);
+        int set_clustering_strategy(const ClusteringStrategy strategy);
+        int set_consistency_check(const bool enabled);
+        int set_similarity_storage(const SimilarityStorage storage);
+        int set_sparse_similarity_floor(const float floor);
+        int set_neighbor_index(const uint16_t m, const uint16_t ef_construction, const uint16_t ef_search);
+        int set_calibration_threads(const uint16_t threads);
+        int set_model_output(const char* name);
+        int set_inference_scheduling(const std::vector<uint16_t> &boundaries, const uint32_t max_batch_tokens);
+        InferenceStats get_inference_stats();
+        int set_centroid_fast_path(const float band);
+        std::tuple<uint64_t, uint64_t> get_centroid_fast_path_stats();
+        // Result is ClusteringResult, ClusteringResultV2 or ClusteringDeltaResult.
+        template<typename Result>
+        int add_textual_item(const char* text, const int idx, Result* result);
+        template<typename Result>
+        int add_textual_items(const char** texts, const int* idxs, const int count, Result* result);
+        template<typename Result>
+        int remove_textual_item(const int idx, const int from_add, Result* result);
+        template<typename Index>
+        int recompute_clustering_threshold(const BasicClusterDefinition<Index>* clusters, BasicClusteringResult<Index>* result);
+        template<typename Index>
+        int clusters_at_threshold(const float threshold, BasicClusteringResult<Index>* result);
 };
 
 template<typename T1>
@@ -0,0 +1,220 @@
+//
+//  dendrogram.cpp
+//
+
+#include "dendrogram.hpp"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+constexpr uint32_t Dendrogram::no_item;
+
+void Dendrogram::sort_links() {
+    std::sort(this->links.begin(), this->links.end(), [](const Link &a, const Link &b){ return a.similarity > b.similarity; });
+}
+
+// Add a piece to the tree being grown, and keep for every member outside of the tree its most
+// similar item in it.
+void Dendrogram::join(const SimilarityMatrix &similarities, const uint32_t piece) {
+    this->joined_members.clear();
+    
+    for (size_t k = 0;k < this->members.size();k++) {
+        if (this->member_pieces[k] == piece) {
+            this->joined_items[this->members[k]] = true;
+            this->joined_members.push_back(this->members[k]);
+        }
+    }
+    
+    for (const uint32_t item : this->joined_members) {
+        if (similarities.get_storage() == SPARSE_SIMILARITIES) {
+            for (const SimilarityEdge &edge : similarities.edges(item)) {
+                if (this->tree_members[edge.item] && !this->joined_items[edge.item] && edge.similarity > this->best_similarities[edge.item]) {
+                    this->best_similarities[edge.item] = edge.similarity;
+                    this->best_items[edge.item] = item;
+                }
+            }
+            
+            continue;
+        }
+        
+        SimilarityRow row = similarities[item];
+        
+        for (const uint32_t member : this->members) {
+            if (!this->joined_items[member] && row[member] > this->best_similarities[member]) {
+                this->best_similarities[member] = row[member];
+                this->best_items[member] = item;
+            }
+        }
+    }
+}
+
+// Link the members into a maximum spanning forest, the pieces they already form staying whole.
+// This is Prim's algorithm over the pieces, in O(m²) for m members, and a new tree is started
+// when no similarity reaches the current one.
+void Dendrogram::connect(const SimilarityMatrix &similarities) {
+    this->member_pieces.resize(this->members.size());
+    this->tree_members.assign(this->items, false);
+    this->joined_items.assign(this->items, false);
+    this->best_similarities.assign(this->items, -std::numeric_limits<float>::infinity());
+    this->best_items.assign(this->items, Dendrogram::no_item);
+    
+    for (size_t k = 0;k < this->members.size();k++) {
+        this->member_pieces[k] = this->pieces.find(this->members[k]);
+        this->tree_members[this->members[k]] = true;
+    }
+    
+    while (true) {
+        size_t next = this->members.size();
+        
+        for (size_t k = 0;k < this->members.size();k++) {
+            uint32_t member = this->members[k];
+            
+            if (!this->joined_items[member] && (next == this->members.size() || this->best_similarities[member] > this->best_similarities[this->members[next]])) {
+                next = k;
+            }
+        }
+        
+        if (next == this->members.size()) {
+            break;
+        }
+        
+        uint32_t item = this->members[next];
+        
+        if (this->best_items[item] != Dendrogram::no_item) {
+            this->links.push_back(Link{this->best_similarities[item], this->best_items[item], item});
+        }
+        
+        this->join(similarities, this->member_pieces[next]);
+    }
+}
+
+void Dendrogram::build(const SimilarityMatrix &similarities, const std::vector<bool> &null_items) {
+    this->items = null_items.size();
+    this->links.clear();
+    this->members.clear();
+    this->pieces.reset(this->items);
+    
+    for (uint32_t i = 0;i < this->items;i++) {
+        if (!null_items[i]) {
+            this->members.push_back(i);
+        }
+    }
+    
+    this->connect(similarities);
+    this->sort_links();
+}
+
+// The maximum spanning forest of the graph with the new items is one of the forest and of the
+// similarities of these items, so Kruskal's algorithm only runs over these, in O(kn log n) for k
+// items.
+void Dendrogram::insert(const std::vector<size_t> &positions, const SimilarityMatrix &similarities, const std::vector<bool> &null_items) {
+    for (Link &link : this->links) {
+        link.item1 = inserted_position(positions, link.item1);
+        link.item2 = inserted_position(positions, link.item2);
+    }
+    
+    this->items += positions.size();
+    this->item_links.clear();
+    
+    // A pair of new items is taken from the first one only.
+    for (const size_t idx : positions) {
+        if (null_items[idx]) {
+            continue;
+        }
+        
+        if (similarities.get_storage() == SPARSE_SIMILARITIES) {
+            for (const SimilarityEdge &edge : similarities.edges(idx)) {
+                if (edge.item != idx && !null_items[edge.item] && (edge.item > idx || !std::binary_search(positions.begin(), positions.end(), edge.item))) {
+                    this->item_links.push_back(Link{edge.similarity, uint32_t(idx), edge.item});
+                }
+            }
+        } else {
+            SimilarityRow row = similarities[idx];
+            
+            for (uint32_t j = 0;j < row.size();j++) {
+                if (j != idx && !null_items[j] && (j > idx || !std::binary_search(positions.begin(), positions.end(), j))) {
+                    this->item_links.push_back(Link{row[j], uint32_t(idx), j});
+                }
+            }
+        }
+    }
+    
+    if (this->item_links.empty()) {
+        return;
+    }
+    
+    auto stronger = [](const Link &a, const Link &b){ return a.similarity > b.similarity; };
+    
+    std::sort(this->item_links.begin(), this->item_links.end(), stronger);
+    this->merged_links.clear();
+    std::merge(this->links.begin(), this->links.end(), this->item_links.begin(), this->item_links.end(), std::back_inserter(this->merged_links), stronger);
+    this->pieces.reset(this->items);
+    this->links.clear();
+    
+    for (const Link &link : this->merged_links) {
+        if (this->pieces.unite(link.item1, link.item2)) {
+            this->links.push_back(link);
+        }
+    }
+}
+
+// Dropping an item splits its tree into one piece per neighbor. A leaf leaves the rest of the
+// forest maximum, otherwise the pieces of its tree are linked again from their similarities.
+void Dendrogram::erase(const size_t idx, const SimilarityMatrix &similarities) {
+    size_t kept = 0;
+    
+    this->members.clear();
+    
+    for (const Link &link : this->links) {
+        if (link.item1 == idx || link.item2 == idx) {
+            this->members.push_back(link.item1 == idx ? link.item2 : link.item1);
+        } else {
+            this->links[kept++] = link;
+        }
+    }
+    
+    this->links.resize(kept);
+    
+    if (this->members.size() > 1) {
+        this->pieces.reset(this->items);
+        this->tree_members.assign(this->items, false);
+        
+        for (const Link &link : this->links) {
+            this->pieces.unite(link.item1, link.item2);
+        }
+        
+        for (const uint32_t neighbor : this->members) {
+            this->tree_members[this->pieces.find(neighbor)] = true;
+        }
+        
+        this->members.clear();
+        
+        for (uint32_t i = 0;i < this->items;i++) {
+            if (i != idx && this->tree_members[this->pieces.find(i)]) {
+                this->members.push_back(i);
+            }
+        }
+        
+        this->connect(similarities);
+        this->sort_links();
+    }
+    
+    for (Link &link : this->links) {
+        link.item1 -= link.item1 > idx;
+        link.item2 -= link.item2 > idx;
+    }
+    
+    this->items--;
+}
+
+void Dendrogram::cut(const float threshold, UnionFind &components) const {
+    components.reset(this->items);
+    
+    for (const Link &link : this->links) {
+        if (link.similarity < threshold) {
+            break;
+        }
+        
+        components.unite(link.item1, link.item2);
+    }
+}
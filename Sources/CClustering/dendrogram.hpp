@@ -0,0 +1,60 @@
+//
+//  dendrogram.hpp
+//
+
+#ifndef dendrogram_hpp
+#define dendrogram_hpp
+
+#include "similarity_matrix.hpp"
+#include "union_find.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Single-linkage dendrogram of the items, kept as a maximum spanning forest of the similarity
+// graph. Two items are linked through similarities at or above a threshold in the forest exactly
+// when they are in the graph, so the clusters of every threshold are a cut of the forest, in O(n)
+// from its links sorted by decreasing similarity. Null items stay out of the forest. Items can be
+// inserted or erased at any position like in the similarity matrix.
+class Dendrogram {
+    private:
+        // No item reaches the tree being grown.
+        static constexpr uint32_t no_item = UINT32_MAX;
+        
+        struct Link {
+            float similarity;
+            uint32_t item1;
+            uint32_t item2;
+        };
+        
+        // Links of the forest by decreasing similarity.
+        std::vector<Link> links;
+        size_t items = 0;
+        UnionFind pieces;
+        std::vector<Link> item_links;
+        std::vector<Link> merged_links;
+        std::vector<uint32_t> members;
+        std::vector<uint32_t> member_pieces;
+        std::vector<uint32_t> joined_members;
+        std::vector<bool> tree_members;
+        std::vector<bool> joined_items;
+        std::vector<float> best_similarities;
+        std::vector<uint32_t> best_items;
+        
+        void join(const SimilarityMatrix &similarities, const uint32_t piece);
+        void connect(const SimilarityMatrix &similarities);
+        void sort_links();
+    public:
+        size_t size() const { return this->items; }
+        
+        void build(const SimilarityMatrix &similarities, const std::vector<bool> &null_items);
+        // Link the items inserted at positions, sorted, see SimilarityMatrix::insert. Their
+        // similarities must already be in the matrix.
+        void insert(const std::vector<size_t> &positions, const SimilarityMatrix &similarities, const std::vector<bool> &null_items);
+        // Unlink the item at idx, must be called before its similarities are erased.
+        void erase(const size_t idx, const SimilarityMatrix &similarities);
+        // Components of the items linked at or above the threshold.
+        void cut(const float threshold, UnionFind &components) const;
+};
+
+#endif /* dendrogram_hpp */
@@ -0,0 +1,287 @@
+//
+//  hnsw_index.cpp
+//
+
+#include "hnsw_index.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+
+HnswIndex::HnswIndex(const size_t dimension, const uint16_t m, const uint16_t ef_construction, const uint16_t ef_search) : dot_product(kernels::dot_product_function()), vectors(dimension), generator(100) {
+    this->m = std::max<uint16_t>(m, 2);
+    this->ef_construction = std::max(ef_construction, this->m);
+    this->ef_search = std::max<uint16_t>(ef_search, 1);
+    this->level_multiplier = 1 / std::log(double(this->m));
+}
+
+inline float HnswIndex::similarity(const float* query, const uint32_t node) const {
+    return this->dot_product(query, this->vectors.row(node), this->vectors.columns());
+}
+
+size_t HnswIndex::memory_size() const {
+    size_t links = 0;
+    
+    for (const Node &node : this->nodes) {
+        for (const std::vector<uint32_t> &level_links : node.links) {
+            links += level_links.capacity();
+        }
+    }
+    
+    return sizeof(float) * this->vectors.size() * this->vectors.row_stride() + sizeof(Node) * this->nodes.capacity() + sizeof(uint32_t) * (links + this->position_nodes.capacity() + this->visited.capacity());
+}
+
+int HnswIndex::random_level() {
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    
+    return int(-std::log(1.0 - distribution(this->generator)) * this->level_multiplier);
+}
+
+// Hill climbing on one level, used above the level where the search widens.
+uint32_t HnswIndex::greedy_search(const float* query, const uint32_t entry, const int level) const {
+    uint32_t current = entry;
+    float current_similarity = this->similarity(query, current);
+    bool changed = true;
+    
+    while (changed) {
+        changed = false;
+        
+        for (const uint32_t neighbor : this->nodes[current].links[level]) {
+            float neighbor_similarity = this->similarity(query, neighbor);
+            
+            if (neighbor_similarity > current_similarity) {
+                current = neighbor;
+                current_similarity = neighbor_similarity;
+                changed = true;
+            }
+        }
+    }
+    
+    return current;
+}
+
+// Best-first search keeping the ef most similar nodes, returned by decreasing similarity.
+std::vector<HnswIndex::Candidate> HnswIndex::search_layer(const float* query, const uint32_t entry, const size_t ef, const int level) {
+    std::priority_queue<Candidate> candidates;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> results;
+    
+    if (++this->visited_epoch == 0) {
+        std::fill(this->visited.begin(), this->visited.end(), 0);
+        this->visited_epoch = 1;
+    }
+    
+    this->visited[entry] = this->visited_epoch;
+    candidates.push(Candidate(this->similarity(query, entry), entry));
+    results.push(candidates.top());
+    
+    while (!candidates.empty()) {
+        Candidate candidate = candidates.top();
+        
+        if (candidate.first < results.top().first && results.size() >= ef) {
+            break;
+        }
+        
+        candidates.pop();
+        
+        for (const uint32_t neighbor : this->nodes[candidate.second].links[level]) {
+            if (this->visited[neighbor] == this->visited_epoch) {
+                continue;
+            }
+            
+            this->visited[neighbor] = this->visited_epoch;
+            
+            float neighbor_similarity = this->similarity(query, neighbor);
+            
+            if (results.size() < ef || neighbor_similarity > results.top().first) {
+                candidates.push(Candidate(neighbor_similarity, neighbor));
+                results.push(Candidate(neighbor_similarity, neighbor));
+                
+                if (results.size() > ef) {
+                    results.pop();
+                }
+            }
+        }
+    }
+    
+    std::vector<Candidate> sorted_results(results.size());
+    
+    for (size_t i = sorted_results.size();i > 0;i--) {
+        sorted_results[i - 1] = results.top();
+        results.pop();
+    }
+    
+    return sorted_results;
+}
+
+// Keep a candidate only when it is more similar to the base node than to every neighbor already
+// kept, so the links spread in every direction instead of all pointing into the same cluster.
+std::vector<uint32_t> HnswIndex::select_neighbors(const std::vector<Candidate> &candidates, const size_t count) const {
+    std::vector<uint32_t> neighbors;
+    
+    for (const Candidate &candidate : candidates) {
+        if (neighbors.size() >= count) {
+            break;
+        }
+        
+        bool diverse = true;
+        
+        for (const uint32_t neighbor : neighbors) {
+            if (this->similarity(this->vectors.row(candidate.second), neighbor) > candidate.first) {
+                diverse = false;
+                break;
+            }
+        }
+        
+        if (diverse) {
+            neighbors.push_back(candidate.second);
+        }
+    }
+    
+    return neighbors;
+}
+
+void HnswIndex::add_link(const uint32_t node, const uint32_t neighbor, const int level) {
+    std::vector<uint32_t> &links = this->nodes[node].links[level];
+    size_t max_links = level == 0 ? 2 * this->m : this->m;
+    
+    if (links.size() < max_links) {
+        links.push_back(neighbor);
+        
+        return;
+    }
+    
+    std::vector<Candidate> candidates;
+    const float* vector = this->vectors.row(node);
+    
+    candidates.reserve(links.size() + 1);
+    candidates.push_back(Candidate(this->similarity(vector, neighbor), neighbor));
+    
+    for (const uint32_t link : links) {
+        candidates.push_back(Candidate(this->similarity(vector, link), link));
+    }
+    
+    std::sort(candidates.begin(), candidates.end(), std::greater<Candidate>());
+    
+    links = this->select_neighbors(candidates, max_links);
+}
+
+void HnswIndex::connect(const uint32_t node) {
+    int level = this->random_level();
+    const float* vector = this->vectors.row(node);
+    
+    this->nodes[node].links.assign(level + 1, std::vector<uint32_t>());
+    
+    if (this->max_level < 0) {
+        this->entry_point = node;
+        this->max_level = level;
+        
+        return;
+    }
+    
+    uint32_t entry = this->entry_point;
+    
+    for (int current_level = this->max_level;current_level > level;current_level--) {
+        entry = this->greedy_search(vector, entry, current_level);
+    }
+    
+    for (int current_level = std::min(level, this->max_level);current_level >= 0;current_level--) {
+        std::vector<Candidate> candidates = this->search_layer(vector, entry, this->ef_construction, current_level);
+        std::vector<uint32_t> neighbors = this->select_neighbors(candidates, this->m);
+        
+        for (const uint32_t neighbor : neighbors) {
+            this->add_link(neighbor, node, current_level);
+        }
+        
+        this->nodes[node].links[current_level] = neighbors;
+        entry = candidates.front().second;
+    }
+    
+    if (level > this->max_level) {
+        this->entry_point = node;
+        this->max_level = level;
+    }
+}
+
+// Insert a normalized vector before position.
+void HnswIndex::insert(const size_t position, const float* vector) {
+    uint32_t node = this->nodes.size();
+    
+    this->vectors.insert_row(node);
+    std::copy(vector, vector + this->vectors.columns(), this->vectors.row(node));
+    this->nodes.push_back(Node{uint32_t(position), false, std::vector<std::vector<uint32_t>>()});
+    this->visited.push_back(0);
+    this->position_nodes.insert(this->position_nodes.begin() + position, node);
+    
+    for (size_t i = position + 1;i < this->position_nodes.size();i++) {
+        this->nodes[this->position_nodes[i]].position = i;
+    }
+    
+    this->connect(node);
+}
+
+void HnswIndex::erase(const size_t position) {
+    this->nodes[this->position_nodes[position]].erased = true;
+    this->erased_nodes++;
+    this->position_nodes.erase(this->position_nodes.begin() + position);
+    
+    for (size_t i = position;i < this->position_nodes.size();i++) {
+        this->nodes[this->position_nodes[i]].position = i;
+    }
+    
+    if (this->erased_nodes > this->position_nodes.size()) {
+        this->rebuild();
+    }
+}
+
+// Insert the live vectors again, in position order, into an empty graph.
+void HnswIndex::rebuild() {
+    Matrix old_vectors = this->vectors;
+    std::vector<uint32_t> old_position_nodes = this->position_nodes;
+    
+    this->vectors.reset(0, old_vectors.columns());
+    this->nodes.clear();
+    this->position_nodes.clear();
+    this->visited.clear();
+    this->entry_point = 0;
+    this->max_level = -1;
+    this->erased_nodes = 0;
+    
+    for (size_t i = 0;i < old_position_nodes.size();i++) {
+        this->insert(i, old_vectors.row(old_position_nodes[i]));
+    }
+}
+
+std::vector<SimilarityEdge> HnswIndex::search(const float* query, const float floor) {
+    std::vector<SimilarityEdge> neighbors;
+    
+    if (this->max_level < 0) {
+        return neighbors;
+    }
+    
+    uint32_t entry = this->entry_point;
+    
+    for (int level = this->max_level;level > 0;level--) {
+        entry = this->greedy_search(query, entry, level);
+    }
+    
+    std::vector<Candidate> candidates;
+    
+    for (size_t ef = this->ef_search;;ef *= 2) {
+        candidates = this->search_layer(query, entry, ef, 0);
+        
+        if (candidates.size() < ef || candidates.back().first < floor) {
+            break;
+        }
+    }
+    
+    for (const Candidate &candidate : candidates) {
+        if (candidate.first >= floor && !this->nodes[candidate.second].erased) {
+            neighbors.push_back(SimilarityEdge{this->nodes[candidate.second].position, candidate.first});
+        }
+    }
+    
+    std::sort(neighbors.begin(), neighbors.end(), [](const SimilarityEdge &a, const SimilarityEdge &b){ return a.item < b.item; });
+    
+    return neighbors;
+}
@@ -0,0 +1,68 @@
+//
+//  hnsw_index.hpp
+//
+
+#ifndef hnsw_index_hpp
+#define hnsw_index_hpp
+
+#include "matrix.hpp"
+#include "kernels.hpp"
+#include "similarity_matrix.hpp"
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Hierarchical navigable small world graph (Malkov and Yashunin) over normalized embeddings,
+// searched by dot product. Items are addressed by their position like in the rest of the
+// clustering while the graph links stable node ids, so inserting or erasing an item only
+// renumbers the positions. Erased nodes stay in the graph to keep it navigable until they
+// outnumber the live ones, then the graph is rebuilt.
+class HnswIndex {
+    private:
+        // Similarity with the query, node id.
+        typedef std::pair<float, uint32_t> Candidate;
+        
+        struct Node {
+            uint32_t position;
+            bool erased;
+            std::vector<std::vector<uint32_t>> links;
+        };
+        
+        kernels::DotProductFunction dot_product;
+        Matrix vectors;
+        std::vector<Node> nodes;
+        std::vector<uint32_t> position_nodes;
+        uint32_t entry_point = 0;
+        int max_level = -1;
+        size_t erased_nodes = 0;
+        uint16_t m;
+        uint16_t ef_construction;
+        uint16_t ef_search;
+        double level_multiplier;
+        std::mt19937 generator;
+        std::vector<uint32_t> visited;
+        uint32_t visited_epoch = 0;
+        
+        inline float similarity(const float* query, const uint32_t node) const;
+        int random_level();
+        uint32_t greedy_search(const float* query, const uint32_t entry, const int level) const;
+        std::vector<Candidate> search_layer(const float* query, const uint32_t entry, const size_t ef, const int level);
+        std::vector<uint32_t> select_neighbors(const std::vector<Candidate> &candidates, const size_t count) const;
+        void add_link(const uint32_t node, const uint32_t neighbor, const int level);
+        void connect(const uint32_t node);
+        void rebuild();
+    public:
+        HnswIndex(const size_t dimension, const uint16_t m = 16, const uint16_t ef_construction = 200, const uint16_t ef_search = 64);
+        
+        size_t size() const { return this->position_nodes.size(); }
+        size_t memory_size() const;
+        void insert(const size_t position, const float* vector);
+        void erase(const size_t position);
+        // Approximate range search: every item whose similarity with query is at or above floor,
+        // sorted by position. ef starts at ef_search and doubles while the results are all above
+        // the floor.
+        std::vector<SimilarityEdge> search(const float* query, const float floor);
+};
+
+#endif /* hnsw_index_hpp */
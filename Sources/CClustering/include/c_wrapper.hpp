@@ -8,6 +8,7 @@
 #define c_wrapper_hpp
 
 #include <stdint.h>
+#include "result_abi.hpp"
 
 
 struct ClusterDefinition {
@@ -22,12 +23,106 @@ struct ClusteringResult {
     float performance;
 };
 
+struct ClusterDefinitionV2 {
+    uint32_t* indices;
+    uint32_t indices_size;
+    uint32_t* clusters_split;
+    uint32_t clusters_split_size;
+};
+
+struct ClusteringResultV2 {
+    struct ClusterDefinitionV2* cluster;
+    float performance_tokenizer;
+    float performance_inference;
+    float performance_clustering;
+};
+
+// Only what changed since the previous clustering, clusters designated by ids that stay the same
+// across the calls. Item moved_items[i] now belongs to cluster moved_clusters[i], and likewise for
+// the merged and split pairs. Items removed with their cluster are not listed as moved.
+struct ClusteringDelta {
+    uint64_t version;
+    uint32_t* moved_items;
+    uint32_t* moved_clusters;
+    uint32_t moved_size;
+    uint32_t* created_clusters;
+    uint32_t created_size;
+    uint32_t* removed_clusters;
+    uint32_t removed_size;
+    uint32_t* merged_from;
+    uint32_t* merged_into;
+    uint32_t merged_size;
+    uint32_t* split_from;
+    uint32_t* split_into;
+    uint32_t split_size;
+};
+
+struct ClusteringDeltaResult {
+    struct ClusteringDelta* delta;
+    float performance_tokenizer;
+    float performance_inference;
+    float performance_clustering;
+};
+
+struct InferenceStats {
+    uint64_t batches;
+    uint64_t sequences;
+    uint64_t tokens;
+    uint64_t padding_tokens;
+    float mean_queue_latency;
+    float max_queue_latency;
+    float inference_time;
+    uint64_t allocations;
+};
+
 
 void* createClustering(const float threshold, const char* model_path, uint16_t hidden_size, const char* tokenizer_model_path, uint16_t max_seq_length);
 int add_textual_item(void* handle, const char* text, const int idx, struct ClusteringResult* result);
+// Add count items, idxs[i] being the position of texts[i] once all are added, with a single
+// clustering. Returns -1 without adding anything, and an empty result, when an idx is out of range
+// or repeated.
+int add_textual_items(void* handle, const char** texts, const int* idxs, const int count, struct ClusteringResult* result);
 int remove_textual_item(void* handle, const int idx, const int from_add, struct ClusteringResult* result);
 int recompute_clustering_threshold(void* handle, const struct ClusterDefinition* expected_clusters, struct ClusteringResult* result);
+int add_textual_item_v2(void* handle, const char* text, const int idx, struct ClusteringResultV2* result);
+int add_textual_items_v2(void* handle, const char** texts, const int* idxs, const int count, struct ClusteringResultV2* result);
+int remove_textual_item_v2(void* handle, const int idx, const int from_add, struct ClusteringResultV2* result);
+int recompute_clustering_threshold_v2(void* handle, const struct ClusterDefinitionV2* expected_clusters, struct ClusteringResultV2* result);
+int add_textual_item_delta(void* handle, const char* text, const int idx, struct ClusteringDeltaResult* result);
+int add_textual_items_delta(void* handle, const char** texts, const int* idxs, const int count, struct ClusteringDeltaResult* result);
+int remove_textual_item_delta(void* handle, const int idx, const int from_add, struct ClusteringDeltaResult* result);
+int get_result_abi_version(void);
 float get_threshold(void* handle);
+// The average and complete linkages work over the dense or packed similarities: they are rejected
+// with -1 under the sparse storage, and so is the sparse storage under them.
+int set_clustering_strategy(void* handle, const int strategy);
+int set_consistency_check(void* handle, const int enabled);
+int set_similarity_storage(void* handle, const int storage);
+int set_sparse_similarity_floor(void* handle, const float floor);
+// Find the neighbors of the inserted items in the sparse storage with an HNSW index, m = 0 drops it.
+// The search is approximate: a missed neighbor is a missing edge, so the clusters can differ from the
+// exact sparse ones, and change when the similarities are fully rebuilt. set_consistency_check does
+// not detect it. The index is only built from 10,000 items, under which an exact row is faster.
+int set_neighbor_index(void* handle, const uint16_t m, const uint16_t ef_construction, const uint16_t ef_search);
+int set_calibration_threads(void* handle, const uint16_t threads);
+// Add the items from the centroids of the clusters unless their similarity with the nearest one is
+// within band of the threshold, a negative band disables it. The stats count both outcomes.
+int set_centroid_fast_path(void* handle, const float band);
+int get_centroid_fast_path_stats(void* handle, uint64_t* hits, uint64_t* misses);
+// Inference batches the sequences of add_textual_items whose lengths fall in the same bucket,
+// boundaries being the increasing largest length of every bucket, up to max_batch_tokens padded
+// tokens. add_textual_item returns the clusters of its item, so it runs it alone.
+int set_inference_scheduling(void* handle, const uint16_t* boundaries, const int boundaries_size, const uint32_t max_batch_tokens);
+int get_inference_stats(void* handle, struct InferenceStats* stats);
+// Name of the model output taken as the embeddings, of shape [batch, hidden_size] or, keeping the
+// first token, [batch, seq, hidden_size]. The first output by default.
+int set_model_output(void* handle, const char* name);
+// Clusters of the connected components strategy at any threshold, without changing the threshold
+// nor the cluster ids of the delta results. They are cut from a dendrogram built when the strategy
+// is set and maintained on every add and remove. Returns -1 and an empty result under another
+// strategy, or under the floor of the sparse storage.
+int clusters_at_threshold(void* handle, const float threshold, struct ClusteringResult* result);
+int clusters_at_threshold_v2(void* handle, const float threshold, struct ClusteringResultV2* result);
 void removeClustering(void* handle);
 
 #endif /* c_wrapper_hpp */
@@ -0,0 +1,12 @@
+//
+//  result_abi.hpp
+//
+
+#ifndef result_abi_hpp
+#define result_abi_hpp
+
+// Version 2 of the result ABI encodes the indices on 32 bits for the stores above 65535 items, the
+// original functions fail with -1 and empty clusters for such stores.
+#define CLUSTERING_RESULT_ABI_VERSION 2
+
+#endif /* result_abi_hpp */
@@ -0,0 +1,116 @@
+//
+//  inference_scheduler.cpp
+//
+
+#include "inference_scheduler.hpp"
+#include <algorithm>
+
+InferenceScheduler::InferenceScheduler(const size_t hidden_size, const BatchRunner &runner) : hidden_size(hidden_size), runner(runner) {
+    this->buckets.resize(this->boundaries.size());
+}
+
+int InferenceScheduler::configure(const std::vector<uint16_t> &boundaries, const uint32_t max_batch_tokens) {
+    if (boundaries.empty() || max_batch_tokens == 0) {
+        return -1;
+    }
+    
+    for (size_t b = 1;b < boundaries.size();b++) {
+        if (boundaries[b] <= boundaries[b - 1]) {
+            return -1;
+        }
+    }
+    
+    this->flush();
+    this->boundaries = boundaries;
+    this->max_batch_tokens = max_batch_tokens;
+    this->buckets.assign(this->boundaries.size(), Bucket());
+    
+    return 0;
+}
+
+void InferenceScheduler::run(Bucket &bucket) {
+    if (bucket.requests.empty()) {
+        return;
+    }
+    
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    // A single sequence is written in place, a batch goes through one block scattered to the rows.
+    bool in_place = bucket.requests.size() == 1;
+    
+    if (!in_place) {
+        resize_workspace(this->batch_embeddings, bucket.requests.size() * this->hidden_size, this->allocations);
+    }
+    
+    float inference_time = this->runner(bucket.input_ids.data(), bucket.requests.size(), in_place ? bucket.requests.front().embedding : this->batch_embeddings.data());
+    
+    for (size_t k = 0;k < bucket.requests.size();k++) {
+        const Request &request = bucket.requests[k];
+        float latency = std::chrono::duration_cast<std::chrono::nanoseconds>(start - request.submitted).count() / 1000000.0;
+        
+        if (!in_place) {
+            std::copy(this->batch_embeddings.begin() + k * this->hidden_size, this->batch_embeddings.begin() + (k + 1) * this->hidden_size, request.embedding);
+        }
+        
+        this->tokens += request.tokens;
+        this->padding_tokens += bucket.longest - request.tokens;
+        this->total_queue_latency += latency;
+        this->max_queue_latency = std::max(this->max_queue_latency, latency);
+    }
+    
+    this->batches++;
+    this->sequences += bucket.requests.size();
+    this->inference_time += inference_time;
+    this->flushed_inference_time += inference_time;
+    bucket.requests.clear();
+    bucket.longest = 0;
+}
+
+void InferenceScheduler::submit(const std::vector<int32_t> &input_ids, float* embedding) {
+    size_t b = std::lower_bound(this->boundaries.begin(), this->boundaries.end(), input_ids.size()) - this->boundaries.begin();
+    Bucket &bucket = this->buckets[std::min(b, this->buckets.size() - 1)];
+    size_t longest = std::max(bucket.longest, input_ids.size());
+    
+    if ((bucket.requests.size() + 1) * longest > this->max_batch_tokens) {
+        this->run(bucket);
+    }
+    
+    size_t k = bucket.requests.size();
+    
+    resize_workspace(bucket.requests, k + 1, this->allocations);
+    bucket.requests[k] = Request{embedding, input_ids.size(), std::chrono::high_resolution_clock::now()};
+    
+    if (k == bucket.input_ids.size()) {
+        resize_workspace(bucket.input_ids, k + 1, this->allocations);
+    }
+    
+    resize_workspace(bucket.input_ids[k], input_ids.size(), this->allocations);
+    std::copy(input_ids.begin(), input_ids.end(), bucket.input_ids[k].begin());
+    bucket.longest = std::max(bucket.longest, input_ids.size());
+}
+
+float InferenceScheduler::flush() {
+    for (Bucket &bucket : this->buckets) {
+        this->run(bucket);
+    }
+    
+    float inference_time = this->flushed_inference_time;
+    
+    this->flushed_inference_time = 0;
+    
+    return inference_time;
+}
+
+InferenceStats InferenceScheduler::get_stats() const {
+    InferenceStats stats;
+    
+    stats.batches = this->batches;
+    stats.sequences = this->sequences;
+    stats.tokens = this->tokens;
+    stats.padding_tokens = this->padding_tokens;
+    stats.mean_queue_latency = this->sequences > 0 ? this->total_queue_latency / this->sequences : 0;
+    stats.max_queue_latency = this->max_queue_latency;
+    stats.inference_time = this->inference_time;
+    stats.allocations = this->allocations;
+    
+    return stats;
+}
@@ -0,0 +1,85 @@
+//
+//  inference_scheduler.hpp
+//
+
+#ifndef inference_scheduler_hpp
+#define inference_scheduler_hpp
+
+#include "inference_workspace.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct InferenceStats {
+    uint64_t batches;
+    uint64_t sequences;
+    // Tokens of the sequences, and padding added to batch them with longer ones.
+    uint64_t tokens;
+    uint64_t padding_tokens;
+    // Milliseconds between the submission of a sequence and the run of its batch.
+    float mean_queue_latency;
+    float max_queue_latency;
+    float inference_time;
+    // Times a reused buffer of the inference had to grow or a tensor was created over one, none
+    // once they fit the workload.
+    uint64_t allocations;
+};
+
+// Queues the tokenized sequences into buckets of similar lengths, so that a batch pads its
+// sequences little. A bucket runs when one more sequence would exceed the token budget of a batch,
+// or when flushed. The calls are synchronous: the embeddings are written when the bucket of a
+// sequence runs, so the sequences submitted before a same flush are the only ones batched together.
+class InferenceScheduler {
+    public:
+        // Write the embeddings of batch_size sequences, hidden_size floats each, and return the
+        // inference time.
+        typedef std::function<float(const std::vector<int32_t>*, const size_t, float*)> BatchRunner;
+    private:
+        struct Request {
+            float* embedding;
+            size_t tokens;
+            std::chrono::high_resolution_clock::time_point submitted;
+        };
+        
+        // The sequences past the requests keep their buffers for the next ones.
+        struct Bucket {
+            std::vector<Request> requests;
+            std::vector<std::vector<int32_t>> input_ids;
+            size_t longest = 0;
+        };
+        
+        size_t hidden_size;
+        BatchRunner runner;
+        // Largest sequence length of every bucket, the last one taking the longer sequences too.
+        std::vector<uint16_t> boundaries = {16, 32, 64, 128, 256, 512};
+        uint32_t max_batch_tokens = 8192;
+        std::vector<Bucket> buckets;
+        std::vector<float> batch_embeddings;
+        uint64_t batches = 0;
+        uint64_t sequences = 0;
+        uint64_t tokens = 0;
+        uint64_t padding_tokens = 0;
+        double total_queue_latency = 0;
+        float max_queue_latency = 0;
+        double inference_time = 0;
+        // Inference time of the runs since the last flush.
+        double flushed_inference_time = 0;
+        uint64_t allocations = 0;
+        
+        void run(Bucket &bucket);
+    public:
+        InferenceScheduler(const size_t hidden_size, const BatchRunner &runner);
+        
+        // Fails when the boundaries are not increasing or the token budget is 0.
+        int configure(const std::vector<uint16_t> &boundaries, const uint32_t max_batch_tokens);
+        // Queue a sequence, its embedding is written to the hidden_size floats at embedding.
+        void submit(const std::vector<int32_t> &input_ids, float* embedding);
+        // Run the queued sequences and return the inference time of the runs since the last flush,
+        // including the ones triggered by the submissions.
+        float flush();
+        InferenceStats get_stats() const;
+};
+
+#endif /* inference_scheduler_hpp */
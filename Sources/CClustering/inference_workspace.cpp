@@ -0,0 +1,59 @@
+//
+//  inference_workspace.cpp
+//
+
+#include "inference_workspace.hpp"
+#include <algorithm>
+
+InferenceWorkspace::InferenceWorkspace(const size_t hidden_size, const int32_t pad_token_id) : hidden_size(hidden_size), pad_token_id(pad_token_id), input_values(3) {
+}
+
+bool InferenceWorkspace::prepare(const std::vector<int32_t>* input_ids, const size_t batch_size, const bool token_states, const size_t tensors) {
+    size_t seq_length = 0;
+    
+    for (size_t b = 0;b < batch_size;b++) {
+        seq_length = std::max(seq_length, input_ids[b].size());
+    }
+    
+    size_t input_size = batch_size * seq_length;
+    size_t output_size = batch_size * this->hidden_size * (token_states ? seq_length : 1);
+    bool rebind = !this->bound || this->token_states != token_states || this->input_dims[0] != static_cast<int64_t>(batch_size) || this->input_dims[1] != static_cast<int64_t>(seq_length);
+    
+    for (std::vector<int32_t> &values : this->input_values) {
+        rebind |= input_size > values.capacity();
+        resize_workspace(values, input_size, this->allocations);
+    }
+    
+    rebind |= output_size > this->output_values.capacity();
+    resize_workspace(this->output_values, output_size, this->allocations);
+    
+    std::fill(this->input_values[INPUT_IDS].begin(), this->input_values[INPUT_IDS].end(), this->pad_token_id);
+    std::fill(this->input_values[ATTENTION_MASK].begin(), this->input_values[ATTENTION_MASK].end(), 0);
+    std::fill(this->input_values[TOKEN_TYPE_IDS].begin(), this->input_values[TOKEN_TYPE_IDS].end(), 0);
+    
+    for (size_t b = 0;b < batch_size;b++) {
+        std::copy(input_ids[b].begin(), input_ids[b].end(), this->input_values[INPUT_IDS].begin() + b * seq_length);
+        std::fill(this->input_values[ATTENTION_MASK].begin() + b * seq_length, this->input_values[ATTENTION_MASK].begin() + b * seq_length + input_ids[b].size(), 1);
+    }
+    
+    if (rebind) {
+        this->input_dims[0] = batch_size;
+        this->input_dims[1] = seq_length;
+        this->output_dims[0] = batch_size;
+        this->output_dims[1] = token_states ? seq_length : this->hidden_size;
+        this->output_dims[2] = this->hidden_size;
+        this->token_states = token_states;
+        this->bound = true;
+        this->allocations += tensors;
+    }
+    
+    return rebind;
+}
+
+void InferenceWorkspace::extract(float* embeddings) const {
+    size_t stride = this->token_states ? this->input_dims[1] * this->hidden_size : this->hidden_size;
+    
+    for (int64_t b = 0;b < this->input_dims[0];b++) {
+        std::copy(this->output_values.begin() + b * stride, this->output_values.begin() + b * stride + this->hidden_size, embeddings + b * this->hidden_size);
+    }
+}
@@ -0,0 +1,65 @@
+//
+//  inference_workspace.hpp
+//
+
+#ifndef inference_workspace_hpp
+#define inference_workspace_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Inputs of the model, known by their name.
+enum ModelInput {
+    INPUT_IDS = 0,
+    ATTENTION_MASK = 1,
+    TOKEN_TYPE_IDS = 2
+};
+
+// Size a buffer reused across the inferences, counting the times it has to grow.
+template<typename T>
+inline void resize_workspace(std::vector<T> &buffer, const size_t size, uint64_t &allocations) {
+    if (size > buffer.capacity()) {
+        allocations++;
+    }
+    
+    buffer.resize(size);
+}
+
+// Buffers the model reads its inputs from and writes its output to, reused across the runs. The
+// tensors over them stay valid until the shape of the batch changes or a buffer grows, so a steady
+// workload allocates nothing: the allocations count both the growths and the tensors created.
+class InferenceWorkspace {
+    private:
+        size_t hidden_size;
+        int32_t pad_token_id;
+        // Indexed by ModelInput.
+        std::vector<std::vector<int32_t>> input_values;
+        // [batch, hidden_size], or [batch, seq, hidden_size] with the token states.
+        std::vector<float> output_values;
+        int64_t input_dims[2] = {0, 0};
+        int64_t output_dims[3] = {0, 0, 0};
+        bool token_states = false;
+        bool bound = false;
+        uint64_t allocations = 0;
+    public:
+        InferenceWorkspace(const size_t hidden_size, const int32_t pad_token_id);
+        
+        // Pad the batch_size sequences to the longest one, and return whether the tensors over the
+        // buffers must be created again, counting that many tensors among the allocations.
+        bool prepare(const std::vector<int32_t>* input_ids, const size_t batch_size, const bool token_states, const size_t tensors);
+        // Copy the embedding of every sequence of the batch, the first token of the token states.
+        void extract(float* embeddings) const;
+        // The tensors are created again for the next batch, the output they are bound to changed.
+        void unbind() { this->bound = false; }
+        
+        std::vector<int32_t>& input(const ModelInput input) { return this->input_values[input]; }
+        const int64_t* get_input_dims() const { return this->input_dims; }
+        float* output() { return this->output_values.data(); }
+        size_t output_size() const { return this->output_values.size(); }
+        const int64_t* get_output_dims() const { return this->output_dims; }
+        size_t output_rank() const { return this->token_states ? 3 : 2; }
+        uint64_t get_allocations() const { return this->allocations; }
+};
+
+#endif /* inference_workspace_hpp */
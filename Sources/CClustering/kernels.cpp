@@ -0,0 +1,580 @@
+//
+//  kernels.cpp
+//
+
+#include "kernels.hpp"
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+float kernels::dot_product_scalar(const float* vector1, const float* vector2, const size_t size) {
+    float sum = 0;
+    
+    for (size_t i = 0;i < size;i++) {
+        sum += vector1[i] * vector2[i];
+    }
+    
+    return sum;
+}
+
+// Reference register-blocked micro-kernel, 4 rows by 4 columns.
+static void micro_kernel_scalar(const float* row1, const float* row2, const size_t stride, const size_t size, float* tile) {
+    float sums[4][4] = {};
+    
+    for (size_t k = 0;k < size;k++) {
+        float a[4] = {row1[k], row1[stride + k], row1[2 * stride + k], row1[3 * stride + k]};
+        float b[4] = {row2[k], row2[stride + k], row2[2 * stride + k], row2[3 * stride + k]};
+        
+        for (size_t r = 0;r < 4;r++) {
+            for (size_t c = 0;c < 4;c++) {
+                sums[r][c] += a[r] * b[c];
+            }
+        }
+    }
+    
+    for (size_t r = 0;r < 4;r++) {
+        for (size_t c = 0;c < 4;c++) {
+            tile[r * 4 + c] = sums[r][c];
+        }
+    }
+}
+
+#if KERNELS_X86
+
+__attribute__((target("sse4.1")))
+static float dot_product_sse4(const float* vector1, const float* vector2, const size_t size) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    __m128 sum2 = _mm_setzero_ps();
+    __m128 sum3 = _mm_setzero_ps();
+    size_t i = 0;
+    
+    for (;i + 16 <= size;i += 16) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(vector1 + i), _mm_loadu_ps(vector2 + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(vector1 + i + 4), _mm_loadu_ps(vector2 + i + 4)));
+        sum2 = _mm_add_ps(sum2, _mm_mul_ps(_mm_loadu_ps(vector1 + i + 8), _mm_loadu_ps(vector2 + i + 8)));
+        sum3 = _mm_add_ps(sum3, _mm_mul_ps(_mm_loadu_ps(vector1 + i + 12), _mm_loadu_ps(vector2 + i + 12)));
+    }
+    
+    for (;i + 4 <= size;i += 4) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(vector1 + i), _mm_loadu_ps(vector2 + i)));
+    }
+    
+    __m128 sum = _mm_add_ps(_mm_add_ps(sum0, sum1), _mm_add_ps(sum2, sum3));
+    
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    
+    float result = _mm_cvtss_f32(sum);
+    
+    for (;i < size;i++) {
+        result += vector1[i] * vector2[i];
+    }
+    
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_product_avx2(const float* vector1, const float* vector2, const size_t size) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    __m256 sum2 = _mm256_setzero_ps();
+    __m256 sum3 = _mm256_setzero_ps();
+    size_t i = 0;
+    
+    for (;i + 32 <= size;i += 32) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i), _mm256_loadu_ps(vector2 + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i + 8), _mm256_loadu_ps(vector2 + i + 8), sum1);
+        sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i + 16), _mm256_loadu_ps(vector2 + i + 16), sum2);
+        sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i + 24), _mm256_loadu_ps(vector2 + i + 24), sum3);
+    }
+    
+    for (;i + 8 <= size;i += 8) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(vector1 + i), _mm256_loadu_ps(vector2 + i), sum0);
+    }
+    
+    __m256 sum256 = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+    
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    
+    float result = _mm_cvtss_f32(sum);
+    
+    for (;i < size;i++) {
+        result += vector1[i] * vector2[i];
+    }
+    
+    return result;
+}
+
+__attribute__((target("avx512f")))
+static float dot_product_avx512(const float* vector1, const float* vector2, const size_t size) {
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    size_t i = 0;
+    
+    for (;i + 32 <= size;i += 32) {
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(vector1 + i), _mm512_loadu_ps(vector2 + i), sum0);
+        sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(vector1 + i + 16), _mm512_loadu_ps(vector2 + i + 16), sum1);
+    }
+    
+    if (i + 16 <= size) {
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(vector1 + i), _mm512_loadu_ps(vector2 + i), sum0);
+        i += 16;
+    }
+    
+    if (i < size) {
+        __mmask16 mask = (__mmask16)((1u << (size - i)) - 1);
+        
+        sum1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, vector1 + i), _mm512_maskz_loadu_ps(mask, vector2 + i), sum1);
+    }
+    
+    return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+}
+
+__attribute__((target("sse4.1")))
+static inline float horizontal_sum_sse4(__m128 sum) {
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    
+    return _mm_cvtss_f32(sum);
+}
+
+// 2 rows by 4 columns, the 8 accumulators and the 6 operands fit in the 16 xmm registers.
+__attribute__((target("sse4.1")))
+static void micro_kernel_sse4(const float* row1, const float* row2, const size_t stride, const size_t size, float* tile) {
+    __m128 sum00 = _mm_setzero_ps(), sum01 = _mm_setzero_ps(), sum02 = _mm_setzero_ps(), sum03 = _mm_setzero_ps();
+    __m128 sum10 = _mm_setzero_ps(), sum11 = _mm_setzero_ps(), sum12 = _mm_setzero_ps(), sum13 = _mm_setzero_ps();
+    
+    for (size_t k = 0;k < size;k += 4) {
+        __m128 a0 = _mm_loadu_ps(row1 + k);
+        __m128 a1 = _mm_loadu_ps(row1 + stride + k);
+        __m128 b = _mm_loadu_ps(row2 + k);
+        
+        sum00 = _mm_add_ps(sum00, _mm_mul_ps(a0, b));
+        sum10 = _mm_add_ps(sum10, _mm_mul_ps(a1, b));
+        b = _mm_loadu_ps(row2 + stride + k);
+        sum01 = _mm_add_ps(sum01, _mm_mul_ps(a0, b));
+        sum11 = _mm_add_ps(sum11, _mm_mul_ps(a1, b));
+        b = _mm_loadu_ps(row2 + 2 * stride + k);
+        sum02 = _mm_add_ps(sum02, _mm_mul_ps(a0, b));
+        sum12 = _mm_add_ps(sum12, _mm_mul_ps(a1, b));
+        b = _mm_loadu_ps(row2 + 3 * stride + k);
+        sum03 = _mm_add_ps(sum03, _mm_mul_ps(a0, b));
+        sum13 = _mm_add_ps(sum13, _mm_mul_ps(a1, b));
+    }
+    
+    tile[0] = horizontal_sum_sse4(sum00);
+    tile[1] = horizontal_sum_sse4(sum01);
+    tile[2] = horizontal_sum_sse4(sum02);
+    tile[3] = horizontal_sum_sse4(sum03);
+    tile[4] = horizontal_sum_sse4(sum10);
+    tile[5] = horizontal_sum_sse4(sum11);
+    tile[6] = horizontal_sum_sse4(sum12);
+    tile[7] = horizontal_sum_sse4(sum13);
+}
+
+__attribute__((target("avx2,fma")))
+static inline float horizontal_sum_avx2(const __m256 sum) {
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    
+    sum128 = _mm_add_ps(sum128, _mm_movehl_ps(sum128, sum128));
+    sum128 = _mm_add_ss(sum128, _mm_shuffle_ps(sum128, sum128, 1));
+    
+    return _mm_cvtss_f32(sum128);
+}
+
+// 2 rows by 4 columns, the 8 accumulators and the 6 operands fit in the 16 ymm registers.
+__attribute__((target("avx2,fma")))
+static void micro_kernel_avx2(const float* row1, const float* row2, const size_t stride, const size_t size, float* tile) {
+    __m256 sum00 = _mm256_setzero_ps(), sum01 = _mm256_setzero_ps(), sum02 = _mm256_setzero_ps(), sum03 = _mm256_setzero_ps();
+    __m256 sum10 = _mm256_setzero_ps(), sum11 = _mm256_setzero_ps(), sum12 = _mm256_setzero_ps(), sum13 = _mm256_setzero_ps();
+    
+    for (size_t k = 0;k < size;k += 8) {
+        __m256 a0 = _mm256_loadu_ps(row1 + k);
+        __m256 a1 = _mm256_loadu_ps(row1 + stride + k);
+        __m256 b = _mm256_loadu_ps(row2 + k);
+        
+        sum00 = _mm256_fmadd_ps(a0, b, sum00);
+        sum10 = _mm256_fmadd_ps(a1, b, sum10);
+        b = _mm256_loadu_ps(row2 + stride + k);
+        sum01 = _mm256_fmadd_ps(a0, b, sum01);
+        sum11 = _mm256_fmadd_ps(a1, b, sum11);
+        b = _mm256_loadu_ps(row2 + 2 * stride + k);
+        sum02 = _mm256_fmadd_ps(a0, b, sum02);
+        sum12 = _mm256_fmadd_ps(a1, b, sum12);
+        b = _mm256_loadu_ps(row2 + 3 * stride + k);
+        sum03 = _mm256_fmadd_ps(a0, b, sum03);
+        sum13 = _mm256_fmadd_ps(a1, b, sum13);
+    }
+    
+    tile[0] = horizontal_sum_avx2(sum00);
+    tile[1] = horizontal_sum_avx2(sum01);
+    tile[2] = horizontal_sum_avx2(sum02);
+    tile[3] = horizontal_sum_avx2(sum03);
+    tile[4] = horizontal_sum_avx2(sum10);
+    tile[5] = horizontal_sum_avx2(sum11);
+    tile[6] = horizontal_sum_avx2(sum12);
+    tile[7] = horizontal_sum_avx2(sum13);
+}
+
+// 4 rows by 4 columns, the 16 accumulators and the 5 operands fit in the 32 zmm registers.
+__attribute__((target("avx512f")))
+static void micro_kernel_avx512(const float* row1, const float* row2, const size_t stride, const size_t size, float* tile) {
+    __m512 sum00 = _mm512_setzero_ps(), sum01 = _mm512_setzero_ps(), sum02 = _mm512_setzero_ps(), sum03 = _mm512_setzero_ps();
+    __m512 sum10 = _mm512_setzero_ps(), sum11 = _mm512_setzero_ps(), sum12 = _mm512_setzero_ps(), sum13 = _mm512_setzero_ps();
+    __m512 sum20 = _mm512_setzero_ps(), sum21 = _mm512_setzero_ps(), sum22 = _mm512_setzero_ps(), sum23 = _mm512_setzero_ps();
+    __m512 sum30 = _mm512_setzero_ps(), sum31 = _mm512_setzero_ps(), sum32 = _mm512_setzero_ps(), sum33 = _mm512_setzero_ps();
+    
+    for (size_t k = 0;k < size;k += 16) {
+        __m512 a0 = _mm512_loadu_ps(row1 + k);
+        __m512 a1 = _mm512_loadu_ps(row1 + stride + k);
+        __m512 a2 = _mm512_loadu_ps(row1 + 2 * stride + k);
+        __m512 a3 = _mm512_loadu_ps(row1 + 3 * stride + k);
+        __m512 b = _mm512_loadu_ps(row2 + k);
+        
+        sum00 = _mm512_fmadd_ps(a0, b, sum00);
+        sum10 = _mm512_fmadd_ps(a1, b, sum10);
+        sum20 = _mm512_fmadd_ps(a2, b, sum20);
+        sum30 = _mm512_fmadd_ps(a3, b, sum30);
+        b = _mm512_loadu_ps(row2 + stride + k);
+        sum01 = _mm512_fmadd_ps(a0, b, sum01);
+        sum11 = _mm512_fmadd_ps(a1, b, sum11);
+        sum21 = _mm512_fmadd_ps(a2, b, sum21);
+        sum31 = _mm512_fmadd_ps(a3, b, sum31);
+        b = _mm512_loadu_ps(row2 + 2 * stride + k);
+        sum02 = _mm512_fmadd_ps(a0, b, sum02);
+        sum12 = _mm512_fmadd_ps(a1, b, sum12);
+        sum22 = _mm512_fmadd_ps(a2, b, sum22);
+        sum32 = _mm512_fmadd_ps(a3, b, sum32);
+        b = _mm512_loadu_ps(row2 + 3 * stride + k);
+        sum03 = _mm512_fmadd_ps(a0, b, sum03);
+        sum13 = _mm512_fmadd_ps(a1, b, sum13);
+        sum23 = _mm512_fmadd_ps(a2, b, sum23);
+        sum33 = _mm512_fmadd_ps(a3, b, sum33);
+    }
+    
+    tile[0] = _mm512_reduce_add_ps(sum00);
+    tile[1] = _mm512_reduce_add_ps(sum01);
+    tile[2] = _mm512_reduce_add_ps(sum02);
+    tile[3] = _mm512_reduce_add_ps(sum03);
+    tile[4] = _mm512_reduce_add_ps(sum10);
+    tile[5] = _mm512_reduce_add_ps(sum11);
+    tile[6] = _mm512_reduce_add_ps(sum12);
+    tile[7] = _mm512_reduce_add_ps(sum13);
+    tile[8] = _mm512_reduce_add_ps(sum20);
+    tile[9] = _mm512_reduce_add_ps(sum21);
+    tile[10] = _mm512_reduce_add_ps(sum22);
+    tile[11] = _mm512_reduce_add_ps(sum23);
+    tile[12] = _mm512_reduce_add_ps(sum30);
+    tile[13] = _mm512_reduce_add_ps(sum31);
+    tile[14] = _mm512_reduce_add_ps(sum32);
+    tile[15] = _mm512_reduce_add_ps(sum33);
+}
+
+#endif
+
+#if KERNELS_NEON
+
+static float dot_product_neon(const float* vector1, const float* vector2, const size_t size) {
+    float32x4_t sum0 = vdupq_n_f32(0);
+    float32x4_t sum1 = vdupq_n_f32(0);
+    float32x4_t sum2 = vdupq_n_f32(0);
+    float32x4_t sum3 = vdupq_n_f32(0);
+    size_t i = 0;
+    
+    for (;i + 16 <= size;i += 16) {
+        sum0 = vfmaq_f32(sum0, vld1q_f32(vector1 + i), vld1q_f32(vector2 + i));
+        sum1 = vfmaq_f32(sum1, vld1q_f32(vector1 + i + 4), vld1q_f32(vector2 + i + 4));
+        sum2 = vfmaq_f32(sum2, vld1q_f32(vector1 + i + 8), vld1q_f32(vector2 + i + 8));
+        sum3 = vfmaq_f32(sum3, vld1q_f32(vector1 + i + 12), vld1q_f32(vector2 + i + 12));
+    }
+    
+    for (;i + 4 <= size;i += 4) {
+        sum0 = vfmaq_f32(sum0, vld1q_f32(vector1 + i), vld1q_f32(vector2 + i));
+    }
+    
+    float result = vaddvq_f32(vaddq_f32(vaddq_f32(sum0, sum1), vaddq_f32(sum2, sum3)));
+    
+    for (;i < size;i++) {
+        result += vector1[i] * vector2[i];
+    }
+    
+    return result;
+}
+
+// 4 rows by 4 columns, the 16 accumulators and the 5 operands fit in the 32 vector registers.
+static void micro_kernel_neon(const float* row1, const float* row2, const size_t stride, const size_t size, float* tile) {
+    float32x4_t sum00 = vdupq_n_f32(0), sum01 = vdupq_n_f32(0), sum02 = vdupq_n_f32(0), sum03 = vdupq_n_f32(0);
+    float32x4_t sum10 = vdupq_n_f32(0), sum11 = vdupq_n_f32(0), sum12 = vdupq_n_f32(0), sum13 = vdupq_n_f32(0);
+    float32x4_t sum20 = vdupq_n_f32(0), sum21 = vdupq_n_f32(0), sum22 = vdupq_n_f32(0), sum23 = vdupq_n_f32(0);
+    float32x4_t sum30 = vdupq_n_f32(0), sum31 = vdupq_n_f32(0), sum32 = vdupq_n_f32(0), sum33 = vdupq_n_f32(0);
+    
+    for (size_t k = 0;k < size;k += 4) {
+        float32x4_t a0 = vld1q_f32(row1 + k);
+        float32x4_t a1 = vld1q_f32(row1 + stride + k);
+        float32x4_t a2 = vld1q_f32(row1 + 2 * stride + k);
+        float32x4_t a3 = vld1q_f32(row1 + 3 * stride + k);
+        float32x4_t b = vld1q_f32(row2 + k);
+        
+        sum00 = vfmaq_f32(sum00, a0, b);
+        sum10 = vfmaq_f32(sum10, a1, b);
+        sum20 = vfmaq_f32(sum20, a2, b);
+        sum30 = vfmaq_f32(sum30, a3, b);
+        b = vld1q_f32(row2 + stride + k);
+        sum01 = vfmaq_f32(sum01, a0, b);
+        sum11 = vfmaq_f32(sum11, a1, b);
+        sum21 = vfmaq_f32(sum21, a2, b);
+        sum31 = vfmaq_f32(sum31, a3, b);
+        b = vld1q_f32(row2 + 2 * stride + k);
+        sum02 = vfmaq_f32(sum02, a0, b);
+        sum12 = vfmaq_f32(sum12, a1, b);
+        sum22 = vfmaq_f32(sum22, a2, b);
+        sum32 = vfmaq_f32(sum32, a3, b);
+        b = vld1q_f32(row2 + 3 * stride + k);
+        sum03 = vfmaq_f32(sum03, a0, b);
+        sum13 = vfmaq_f32(sum13, a1, b);
+        sum23 = vfmaq_f32(sum23, a2, b);
+        sum33 = vfmaq_f32(sum33, a3, b);
+    }
+    
+    tile[0] = vaddvq_f32(sum00);
+    tile[1] = vaddvq_f32(sum01);
+    tile[2] = vaddvq_f32(sum02);
+    tile[3] = vaddvq_f32(sum03);
+    tile[4] = vaddvq_f32(sum10);
+    tile[5] = vaddvq_f32(sum11);
+    tile[6] = vaddvq_f32(sum12);
+    tile[7] = vaddvq_f32(sum13);
+    tile[8] = vaddvq_f32(sum20);
+    tile[9] = vaddvq_f32(sum21);
+    tile[10] = vaddvq_f32(sum22);
+    tile[11] = vaddvq_f32(sum23);
+    tile[12] = vaddvq_f32(sum30);
+    tile[13] = vaddvq_f32(sum31);
+    tile[14] = vaddvq_f32(sum32);
+    tile[15] = vaddvq_f32(sum33);
+}
+
+#endif
+
+namespace {
+    // Depth of the blocks the Gram matrix is accumulated over, keeps the rows of a micro-kernel in L1.
+    const size_t gram_depth_block = 256;
+    // Rows of the panel swept by the micro-kernels, keeps the panel in L2.
+    const size_t gram_rows_block = 64;
+    
+    struct Dispatch {
+        kernels::DotProductFunction dot_product;
+        kernels::MicroKernelFunction micro_kernel;
+        size_t micro_rows;
+        size_t micro_cols;
+        const char* instruction_set;
+    };
+    
+    // Pick the widest instruction set supported by the CPU, the detection runs only once.
+    Dispatch detect_instruction_set() {
+#if KERNELS_X86
+        __builtin_cpu_init();
+        
+        if (__builtin_cpu_supports("avx512f")) {
+            return Dispatch{dot_product_avx512, micro_kernel_avx512, 4, 4, "avx512"};
+        }
+        
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return Dispatch{dot_product_avx2, micro_kernel_avx2, 2, 4, "avx2"};
+        }
+        
+        if (__builtin_cpu_supports("sse4.1")) {
+            return Dispatch{dot_product_sse4, micro_kernel_sse4, 2, 4, "sse4"};
+        }
+#elif KERNELS_NEON
+        return Dispatch{dot_product_neon, micro_kernel_neon, 4, 4, "neon"};
+#endif
+        return Dispatch{kernels::dot_product_scalar, micro_kernel_scalar, 4, 4, "scalar"};
+    }
+    
+    const Dispatch& current_dispatch() {
+        static const Dispatch dispatch = detect_instruction_set();
+        
+        return dispatch;
+    }
+    
+    // Upper triangle of a square row-major matrix.
+    struct DenseUpperTriangle {
+        float* result;
+        size_t result_stride;
+        
+        float& operator()(const size_t i, const size_t j) const {
+            return this->result[i * this->result_stride + j];
+        }
+    };
+    
+    // Upper triangle packed column by column, see kernels::packed_index.
+    struct PackedUpperTriangle {
+        float* result;
+        
+        float& operator()(const size_t i, const size_t j) const {
+            return this->result[kernels::packed_index(i, j)];
+        }
+    };
+    
+    // Tiled M.M^T product writing the upper triangle, diagonal included, through output. Only the
+    // tiles crossing or above the diagonal are computed. The tiles that do not fit a full
+    // micro-kernel on the edges of the matrix fall back to the dot product kernel.
+    template<typename UpperTriangle>
+    void gram_matrix_blocked(const Dispatch &dispatch, const float* matrix, const size_t rows, const size_t size, const size_t stride, const UpperTriangle &output) {
+        float tile[16];
+        
+        for (size_t i = 0;i < rows;i++) {
+            for (size_t j = i;j < rows;j++) {
+                output(i, j) = 0;
+            }
+        }
+        
+        for (size_t k = 0;k < size;k += gram_depth_block) {
+            size_t depth = std::min(gram_depth_block, size - k);
+            
+            for (size_t j_block = 0;j_block < rows;j_block += gram_rows_block) {
+                size_t j_end = std::min(rows, j_block + gram_rows_block);
+                
+                for (size_t i = 0;i < j_end;i += dispatch.micro_rows) {
+                    size_t i_end = std::min(rows, i + dispatch.micro_rows);
+                    size_t j_start = i <= j_block ? j_block : j_block + (i - j_block) / dispatch.micro_cols * dispatch.micro_cols;
+                    
+                    for (size_t j = j_start;j < j_end;j += dispatch.micro_cols) {
+                        if (i_end - i == dispatch.micro_rows && j + dispatch.micro_cols <= j_end) {
+                            dispatch.micro_kernel(matrix + i * stride + k, matrix + j * stride + k, stride, depth, tile);
+                            
+                            for (size_t r = 0;r < dispatch.micro_rows;r++) {
+                                for (size_t c = 0;c < dispatch.micro_cols;c++) {
+                                    if (i + r <= j + c) {
+                                        output(i + r, j + c) += tile[r * dispatch.micro_cols + c];
+                                    }
+                                }
+                            }
+                        } else {
+                            for (size_t r = i;r < i_end;r++) {
+                                for (size_t c = std::max(r, j);c < std::min(j_end, j + dispatch.micro_cols);c++) {
+                                    output(r, c) += dispatch.dot_product(matrix + r * stride + k, matrix + c * stride + k, depth);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    // Same tiling for the rectangular product of two matrices, where every tile is computed.
+    void cross_gram_matrix_blocked(const Dispatch &dispatch, const float* matrix1, const size_t rows1, const float* matrix2, const size_t rows2, const size_t size, const size_t stride, float* result, const size_t result_stride) {
+        float tile[16];
+        
+        for (size_t i = 0;i < rows1;i++) {
+            std::fill(result + i * result_stride, result + i * result_stride + rows2, 0);
+        }
+        
+        for (size_t k = 0;k < size;k += gram_depth_block) {
+            size_t depth = std::min(gram_depth_block, size - k);
+            
+            for (size_t j_block = 0;j_block < rows2;j_block += gram_rows_block) {
+                size_t j_end = std::min(rows2, j_block + gram_rows_block);
+                
+                for (size_t i = 0;i < rows1;i += dispatch.micro_rows) {
+                    size_t i_end = std::min(rows1, i + dispatch.micro_rows);
+                    
+                    for (size_t j = j_block;j < j_end;j += dispatch.micro_cols) {
+                        if (i_end - i == dispatch.micro_rows && j + dispatch.micro_cols <= j_end) {
+                            dispatch.micro_kernel(matrix1 + i * stride + k, matrix2 + j * stride + k, stride, depth, tile);
+                            
+                            for (size_t r = 0;r < dispatch.micro_rows;r++) {
+                                for (size_t c = 0;c < dispatch.micro_cols;c++) {
+                                    result[(i + r) * result_stride + j + c] += tile[r * dispatch.micro_cols + c];
+                                }
+                            }
+                        } else {
+                            for (size_t r = i;r < i_end;r++) {
+                                for (size_t c = j;c < std::min(j_end, j + dispatch.micro_cols);c++) {
+                                    result[r * result_stride + c] += dispatch.dot_product(matrix1 + r * stride + k, matrix2 + c * stride + k, depth);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    void dense_gram_matrix(const Dispatch &dispatch, const float* matrix, const size_t rows, const size_t size, const size_t stride, float* result, const size_t result_stride) {
+        gram_matrix_blocked(dispatch, matrix, rows, size, stride, DenseUpperTriangle{result, result_stride});
+        
+        for (size_t i = 1;i < rows;i++) {
+            for (size_t j = 0;j < i;j++) {
+                result[i * result_stride + j] = result[j * result_stride + i];
+            }
+        }
+    }
+}
+
+kernels::DotProductFunction kernels::dot_product_function() {
+    return current_dispatch().dot_product;
+}
+
+const char* kernels::instruction_set() {
+    return current_dispatch().instruction_set;
+}
+
+void kernels::gram_matrix_scalar(const float* matrix, const size_t rows, const size_t size, const size_t stride, float* result, const size_t result_stride) {
+    const Dispatch scalar_dispatch = {kernels::dot_product_scalar, micro_kernel_scalar, 4, 4, "scalar"};
+    
+    dense_gram_matrix(scalar_dispatch, matrix, rows, size, stride, result, result_stride);
+}
+
+void kernels::gram_matrix(const float* matrix, const size_t rows, const size_t size, const size_t stride, float* result, const size_t result_stride) {
+    dense_gram_matrix(current_dispatch(), matrix, rows, size, stride, result, result_stride);
+}
+
+void kernels::packed_gram_matrix(const float* matrix, const size_t rows, const size_t size, const size_t stride, float* result) {
+    gram_matrix_blocked(current_dispatch(), matrix, rows, size, stride, PackedUpperTriangle{result});
+}
+
+void kernels::cross_gram_matrix(const float* matrix1, const size_t rows1, const float* matrix2, const size_t rows2, const size_t size, const size_t stride, float* result, const size_t result_stride) {
+    cross_gram_matrix_blocked(current_dispatch(), matrix1, rows1, matrix2, rows2, size, stride, result, result_stride);
+}
+
+kernels::DotProductFunction kernels::dot_product_variant(const char* instruction_set) {
+    if (std::strcmp(instruction_set, "scalar") == 0) {
+        return kernels::dot_product_scalar;
+    }
+    
+#if KERNELS_X86
+    __builtin_cpu_init();
+    
+    if (std::strcmp(instruction_set, "sse4") == 0 && __builtin_cpu_supports("sse4.1")) {
+        return dot_product_sse4;
+    }
+    
+    if (std::strcmp(instruction_set, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return dot_product_avx2;
+    }
+    
+    if (std::strcmp(instruction_set, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        return dot_product_avx512;
+    }
+#elif KERNELS_NEON
+    if (std::strcmp(instruction_set, "neon") == 0) {
+        return dot_product_neon;
+    }
+#endif
+    
+    return nullptr;
+}
@@ -0,0 +1,49 @@
+//
+//  kernels.hpp
+//
+
+#ifndef kernels_hpp
+#define kernels_hpp
+
+#include <cstddef>
+
+// Vectorized float kernels used by the similarity computations. The best implementation
+// available on the running CPU is selected once at startup, the scalar versions are the
+// reference implementations every SIMD variant is compared against.
+namespace kernels {
+    typedef float (*DotProductFunction)(const float* vector1, const float* vector2, const size_t size);
+    // Computes the dot products of `micro_rows` consecutive rows starting at row1 with `micro_cols`
+    // consecutive rows starting at row2, over `size` floats, and writes them row-major into tile.
+    typedef void (*MicroKernelFunction)(const float* row1, const float* row2, const size_t stride, const size_t size, float* tile);
+    
+    // Columns count the Gram matrix kernels must be padded to.
+    const size_t gram_padding = 16;
+    
+    float dot_product_scalar(const float* vector1, const float* vector2, const size_t size);
+    DotProductFunction dot_product_function();
+    const char* instruction_set();
+    // Variant for an instruction set among scalar, sse4, avx2, avx512 and neon, or null when the CPU
+    // does not support it.
+    DotProductFunction dot_product_variant(const char* instruction_set);
+    // Symmetric Gram matrix M.M^T of the rows of matrix into a row-major result. size must be a
+    // multiple of gram_padding with the rows zero-padded accordingly.
+    void gram_matrix_scalar(const float* matrix, const size_t rows, const size_t size, const size_t stride, float* result, const size_t result_stride);
+    void gram_matrix(const float* matrix, const size_t rows, const size_t size, const size_t stride, float* result, const size_t result_stride);
+    // Same product written as a packed upper triangle, see packed_index.
+    void packed_gram_matrix(const float* matrix, const size_t rows, const size_t size, const size_t stride, float* result);
+    // Product M1.M2^T of the rows of two matrices sharing their stride, written row-major like
+    // gram_matrix with the same padding, e.g. the similarities of a few items with all the others.
+    void cross_gram_matrix(const float* matrix1, const size_t rows1, const float* matrix2, const size_t rows2, const size_t size, const size_t stride, float* result, const size_t result_stride);
+    
+    // Position of (i, j), i <= j, in an upper triangle packed column by column: column j holds
+    // rows 0 to j, so appending an item only appends a column.
+    inline size_t packed_index(const size_t i, const size_t j) {
+        return j * (j + 1) / 2 + i;
+    }
+    
+    inline float dot_product(const float* vector1, const float* vector2, const size_t size) {
+        return dot_product_function()(vector1, vector2, size);
+    }
+}
+
+#endif /* kernels_hpp */
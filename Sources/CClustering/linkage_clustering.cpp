@@ -0,0 +1,111 @@
+//
+//  linkage_clustering.cpp
+//
+
+#include "linkage_clustering.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+constexpr uint32_t LinkageClustering::no_cluster;
+
+// Similarity of two clusters, the scratch of the similarity matrix in the upper triangle.
+static inline float& similarity(SimilarityMatrix &similarities, const uint32_t cluster1, const uint32_t cluster2) {
+    return cluster1 < cluster2 ? similarities.scratch(cluster1, cluster2) : similarities.scratch(cluster2, cluster1);
+}
+
+void LinkageClustering::cluster(SimilarityMatrix &similarities, const Matrix &embeddings, const std::vector<bool> &null_items, const Linkage linkage, const float threshold) {
+    assert(similarities.get_storage() != SPARSE_SIMILARITIES);
+    
+    uint32_t clusters = null_items.size();
+    
+    this->items = clusters;
+    this->merges.clear();
+    this->sizes.assign(clusters, 1);
+    this->active.assign(clusters, true);
+    this->overwritten.assign(clusters, false);
+    this->chain.clear();
+    
+    for (uint32_t i = 0;i < clusters;i++) {
+        this->active[i] = !null_items[i];
+    }
+    
+    uint32_t start = 0;
+    
+    while (true) {
+        if (this->chain.empty()) {
+            while (start < clusters && !this->active[start]) {
+                start++;
+            }
+            
+            if (start == clusters) {
+                break;
+            }
+            
+            this->chain.push_back(start);
+        }
+        
+        // On a tie, the previous cluster of the chain is kept so that the chain cannot cycle.
+        uint32_t cluster = this->chain.back();
+        uint32_t previous = this->chain.size() > 1 ? this->chain[this->chain.size() - 2] : LinkageClustering::no_cluster;
+        uint32_t nearest = previous;
+        float best = previous != LinkageClustering::no_cluster ? similarity(similarities, cluster, previous) : -std::numeric_limits<float>::infinity();
+        
+        for (uint32_t other = 0;other < clusters;other++) {
+            if (this->active[other] && other != cluster && similarity(similarities, cluster, other) > best) {
+                nearest = other;
+                best = similarity(similarities, cluster, other);
+            }
+        }
+        
+        if (nearest == LinkageClustering::no_cluster || best < threshold) {
+            this->active[cluster] = false;
+            this->chain.pop_back();
+            continue;
+        }
+        
+        if (nearest != previous) {
+            this->chain.push_back(nearest);
+            continue;
+        }
+        
+        // Reciprocal nearest neighbors, the merged cluster takes the place of the previous one.
+        this->chain.resize(this->chain.size() - 2);
+        this->merges.push_back(SimilarityPair{best, cluster, previous});
+        this->active[cluster] = false;
+        this->overwritten[previous] = true;
+        
+        for (uint32_t other = 0;other < clusters;other++) {
+            if (!this->active[other] || other == previous) {
+                continue;
+            }
+            
+            float &merged = similarity(similarities, previous, other);
+            
+            if (linkage == AVERAGE_LINKAGE) {
+                merged = (this->sizes[cluster] * similarity(similarities, cluster, other) + this->sizes[previous] * merged) / (this->sizes[cluster] + this->sizes[previous]);
+            } else {
+                merged = std::min(merged, similarity(similarities, cluster, other));
+            }
+        }
+        
+        this->sizes[previous] += this->sizes[cluster];
+    }
+    
+    // Only the similarities of the clusters that absorbed another one were overwritten.
+    for (uint32_t i = 0;i < clusters;i++) {
+        if (this->overwritten[i]) {
+            similarities.restore(i, embeddings);
+        }
+    }
+}
+
+void LinkageClustering::cut(const float threshold, UnionFind &components) const {
+    components.reset(this->items);
+    
+    for (const SimilarityPair &merge : this->merges) {
+        if (merge.similarity >= threshold) {
+            components.unite(merge.item1, merge.item2);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+//
+//  linkage_clustering.hpp
+//
+
+#ifndef linkage_clustering_hpp
+#define linkage_clustering_hpp
+
+#include "similarity_matrix.hpp"
+#include "union_find.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum Linkage {
+    // Mean similarity of the items of the two clusters.
+    AVERAGE_LINKAGE = 0,
+    // Lowest similarity of the items of the two clusters.
+    COMPLETE_LINKAGE = 1
+};
+
+// Agglomerative clustering of the non null items with the nearest-neighbor chain algorithm, in
+// O(n²) time. The chain follows nearest neighbors until two clusters are each other's nearest,
+// merges them and updates their similarities with Lance-Williams in place. Both linkages are
+// reducible: merging two clusters never brings them closer to a third one, so a cluster whose
+// nearest neighbor is under the threshold is final and leaves the chain.
+class LinkageClustering {
+    private:
+        static constexpr uint32_t no_cluster = UINT32_MAX;
+        
+        // A cluster is designated by one of its items, its similarities are those of the item in the
+        // similarity matrix, overwritten by the merges and restored at the end.
+        std::vector<uint32_t> sizes;
+        std::vector<bool> active;
+        std::vector<bool> overwritten;
+        std::vector<uint32_t> chain;
+        // Clusters merged at their linkage similarity.
+        std::vector<SimilarityPair> merges;
+        size_t items = 0;
+    public:
+        const std::vector<SimilarityPair>& get_merges() const { return this->merges; }
+        
+        // Merge the clusters while their linkage similarity is at or above the threshold, over the
+        // dense or packed similarities, which are left unchanged. The sparse storage misses the
+        // similarities under its floor that still weigh in the average linkage, so it is not
+        // supported.
+        void cluster(SimilarityMatrix &similarities, const Matrix &embeddings, const std::vector<bool> &null_items, const Linkage linkage, const float threshold);
+        // Components of the items merged at or above the threshold.
+        void cut(const float threshold, UnionFind &components) const;
+};
+
+#endif /* linkage_clustering_hpp */
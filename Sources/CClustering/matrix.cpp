@@ -0,0 +1,185 @@
+//
+//  matrix.cpp
+//
+
+#include "matrix.hpp"
+#include <new>
+#include <utility>
+
+
+Matrix::Matrix(const size_t cols) {
+    this->cols = cols;
+    this->stride = Matrix::padded_size(cols);
+}
+
+Matrix::Matrix(const Matrix &other) : Matrix(other.cols) {
+    this->reallocate(other.rows, other.stride);
+    this->rows = other.rows;
+    
+    if (other.buffer != nullptr) {
+        std::memcpy(this->buffer, other.buffer, sizeof(float) * other.rows * other.stride);
+    }
+}
+
+Matrix::Matrix(Matrix &&other) noexcept {
+    std::swap(this->buffer, other.buffer);
+    std::swap(this->rows, other.rows);
+    std::swap(this->cols, other.cols);
+    std::swap(this->stride, other.stride);
+    std::swap(this->rows_capacity, other.rows_capacity);
+}
+
+Matrix& Matrix::operator=(Matrix other) noexcept {
+    std::swap(this->buffer, other.buffer);
+    std::swap(this->rows, other.rows);
+    std::swap(this->cols, other.cols);
+    std::swap(this->stride, other.stride);
+    std::swap(this->rows_capacity, other.rows_capacity);
+    
+    return *this;
+}
+
+Matrix::~Matrix() {
+    std::free(this->buffer);
+}
+
+size_t Matrix::padded_size(const size_t size) {
+    return std::max<size_t>(1, (size + Matrix::simd_width - 1) / Matrix::simd_width) * Matrix::simd_width;
+}
+
+void Matrix::reallocate(const size_t new_rows_capacity, const size_t new_stride) {
+    void* new_buffer = nullptr;
+    size_t bytes = std::max<size_t>(1, new_rows_capacity * new_stride) * sizeof(float);
+    
+    if (posix_memalign(&new_buffer, Matrix::alignment, bytes) != 0) {
+        throw std::bad_alloc();
+    }
+    
+    std::memset(new_buffer, 0, bytes);
+    
+    if (this->buffer != nullptr) {
+        for (size_t i = 0;i < this->rows;i++) {
+            std::memcpy(static_cast<float*>(new_buffer) + i * new_stride, this->row(i), sizeof(float) * this->cols);
+        }
+        
+        std::free(this->buffer);
+    }
+    
+    this->buffer = static_cast<float*>(new_buffer);
+    this->rows_capacity = new_rows_capacity;
+    this->stride = new_stride;
+}
+
+// Resize the matrix and zero-fill it, the previous content is discarded.
+void Matrix::reset(const size_t new_rows, const size_t new_cols) {
+    size_t new_stride = std::max(this->stride, Matrix::padded_size(new_cols));
+    
+    this->rows = 0;
+    this->cols = new_cols;
+    
+    if (this->buffer == nullptr || new_rows > this->rows_capacity || new_stride > this->stride) {
+        this->reallocate(std::max(new_rows, this->rows_capacity), new_stride);
+    } else {
+        std::memset(this->buffer, 0, sizeof(float) * this->rows_capacity * this->stride);
+    }
+    
+    this->rows = new_rows;
+}
+
+// Insert a zero-filled row before idx.
+void Matrix::insert_row(const size_t idx) {
+    if (this->buffer == nullptr || this->rows == this->rows_capacity) {
+        this->reallocate(std::max<size_t>(1, this->rows_capacity * 2), this->stride);
+    }
+    
+    std::memmove(this->row(idx + 1), this->row(idx), sizeof(float) * (this->rows - idx) * this->stride);
+    std::memset(this->row(idx), 0, sizeof(float) * this->stride);
+    
+    this->rows++;
+}
+
+// Insert zero-filled rows at positions, sorted, which are the positions of the rows once all are
+// inserted. The rows between two of them are moved once, from the last ones.
+void Matrix::insert_rows(const std::vector<size_t> &positions) {
+    size_t new_rows = this->rows + positions.size();
+    
+    if (this->buffer == nullptr || new_rows > this->rows_capacity) {
+        size_t new_capacity = std::max<size_t>(1, this->rows_capacity * 2);
+        
+        while (new_capacity < new_rows) {
+            new_capacity *= 2;
+        }
+        
+        this->reallocate(new_capacity, this->stride);
+    }
+    
+    size_t end = this->rows;
+    
+    for (size_t m = positions.size();m > 0;m--) {
+        size_t start = positions[m - 1] - (m - 1);
+        
+        std::memmove(this->row(positions[m - 1] + 1), this->row(start), sizeof(float) * (end - start) * this->stride);
+        std::memset(this->row(positions[m - 1]), 0, sizeof(float) * this->stride);
+        end = start;
+    }
+    
+    this->rows = new_rows;
+}
+
+void Matrix::erase_row(const size_t idx) {
+    std::memmove(this->row(idx), this->row(idx + 1), sizeof(float) * (this->rows - idx - 1) * this->stride);
+    std::memset(this->row(this->rows - 1), 0, sizeof(float) * this->stride);
+    
+    this->rows--;
+}
+
+// Insert a zero-filled column before idx.
+void Matrix::insert_column(const size_t idx) {
+    if (this->cols == this->stride) {
+        this->reallocate(this->rows_capacity, Matrix::padded_size(this->stride * 2));
+    }
+    
+    for (size_t i = 0;i < this->rows;i++) {
+        float* current_row = this->row(i);
+        
+        std::memmove(current_row + idx + 1, current_row + idx, sizeof(float) * (this->cols - idx));
+        current_row[idx] = 0;
+    }
+    
+    this->cols++;
+}
+
+// Same for columns, in a single pass over the rows.
+void Matrix::insert_columns(const std::vector<size_t> &positions) {
+    size_t new_cols = this->cols + positions.size();
+    
+    if (new_cols > this->stride) {
+        this->reallocate(this->rows_capacity, Matrix::padded_size(std::max(this->stride * 2, new_cols)));
+    }
+    
+    for (size_t i = 0;i < this->rows;i++) {
+        float* current_row = this->row(i);
+        size_t end = this->cols;
+        
+        for (size_t m = positions.size();m > 0;m--) {
+            size_t start = positions[m - 1] - (m - 1);
+            
+            std::memmove(current_row + positions[m - 1] + 1, current_row + start, sizeof(float) * (end - start));
+            current_row[positions[m - 1]] = 0;
+            end = start;
+        }
+    }
+    
+    this->cols = new_cols;
+}
+
+void Matrix::erase_column(const size_t idx) {
+    for (size_t i = 0;i < this->rows;i++) {
+        float* current_row = this->row(i);
+        
+        std::memmove(current_row + idx, current_row + idx + 1, sizeof(float) * (this->cols - idx - 1));
+        current_row[this->cols - 1] = 0;
+    }
+    
+    this->cols--;
+}
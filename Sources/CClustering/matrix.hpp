@@ -0,0 +1,77 @@
+//
+//  matrix.hpp
+//
+
+#ifndef matrix_hpp
+#define matrix_hpp
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+// Non-owning view over one row of a Matrix.
+template<typename T>
+class RowView {
+    private:
+        T* row_data;
+        size_t row_size;
+    public:
+        RowView(T* row_data, const size_t row_size) : row_data(row_data), row_size(row_size) {}
+        template<typename U>
+        RowView(const RowView<U> &other) : row_data(other.data()), row_size(other.size()) {}
+        T* data() const { return this->row_data; }
+        size_t size() const { return this->row_size; }
+        T* begin() const { return this->row_data; }
+        T* end() const { return this->row_data + this->row_size; }
+        T& operator[](const size_t i) const { return this->row_data[i]; }
+        T& back() const { return this->row_data[this->row_size - 1]; }
+};
+
+// Row-major float matrix stored in a single 64 bytes aligned buffer. Each row is padded
+// to a multiple of the SIMD width so that every row starts on an aligned address, and the
+// padding is always zero-filled so kernels can safely run over the whole stride.
+// Rows and columns can be inserted or erased at any position, the capacity of both
+// dimensions grows by doubling.
+class Matrix {
+    private:
+        float* buffer = nullptr;
+        size_t rows = 0;
+        size_t cols = 0;
+        size_t stride = 0;
+        size_t rows_capacity = 0;
+        
+        void reallocate(const size_t new_rows_capacity, const size_t new_stride);
+    public:
+        static const size_t alignment = 64;
+        static const size_t simd_width = alignment / sizeof(float);
+        
+        explicit Matrix(const size_t cols = 0);
+        Matrix(const Matrix &other);
+        Matrix(Matrix &&other) noexcept;
+        Matrix& operator=(Matrix other) noexcept;
+        ~Matrix();
+        
+        static size_t padded_size(const size_t size);
+        size_t size() const { return this->rows; }
+        size_t columns() const { return this->cols; }
+        size_t row_stride() const { return this->stride; }
+        bool empty() const { return this->rows == 0; }
+        float* data() { return this->buffer; }
+        const float* data() const { return this->buffer; }
+        float* row(const size_t i) { return this->buffer + i * this->stride; }
+        const float* row(const size_t i) const { return this->buffer + i * this->stride; }
+        RowView<float> operator[](const size_t i) { return RowView<float>(this->row(i), this->cols); }
+        RowView<const float> operator[](const size_t i) const { return RowView<const float>(this->row(i), this->cols); }
+        
+        void reset(const size_t new_rows, const size_t new_cols);
+        void insert_row(const size_t idx);
+        void erase_row(const size_t idx);
+        void insert_column(const size_t idx);
+        void erase_column(const size_t idx);
+        void insert_rows(const std::vector<size_t> &positions);
+        void insert_columns(const std::vector<size_t> &positions);
+};
+
+#endif /* matrix_hpp */
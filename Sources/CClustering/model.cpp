@@ -0,0 +1,205 @@
+//
+//  model.cpp
+//
+//  Created by Julien Plu on 07/07/2022.
+//
+
+#include "model.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+constexpr int32_t Model::pad_token_id;
+
+Model::Model(std::string model_path, uint16_t hidden_size) : memory_info(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)), workspace(hidden_size, Model::pad_token_id), output_tensor(nullptr) {
+    std::string str_model_path(model_path);
+    this->env = std::make_unique<Ort::Env>(OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR, "clustering");
+    Ort::SessionOptions sessionOptions;
+    
+    sessionOptions.SetIntraOpNumThreads(4);
+    sessionOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+    
+    this->session = std::make_unique<Ort::Session>(*this->env, model_path.data(), sessionOptions);
+    this->binding = std::make_unique<Ort::IoBinding>(*this->session);
+    this->hidden_size = hidden_size;
+    this->valid = this->resolve_metadata() && this->select_output(0) == 0;
+    this->ort_inputs.reserve(this->inputs.size());
+}
+
+// Read the names of the inputs and outputs once, and check that every input is one the model gets
+// as an int32 tensor. Otherwise, or without a valid output, the embeddings are null.
+bool Model::resolve_metadata() {
+    Ort::AllocatorWithDefaultOptions allocator;
+    const std::vector<std::string> known_inputs = {"input_ids", "attention_mask", "token_type_ids"};
+    
+    for (size_t i = 0;i < this->session->GetInputCount();i++) {
+        Ort::TypeInfo type_info = this->session->GetInputTypeInfo(i);
+        std::string name = this->session->GetInputNameAllocated(i, allocator).get();
+        size_t known = std::find(known_inputs.begin(), known_inputs.end(), name) - known_inputs.begin();
+        
+        if (known == known_inputs.size()) {
+            std::cerr << "Unknown model input " << name << ", expected input_ids, attention_mask or token_type_ids." << std::endl;
+            
+            return false;
+        }
+        
+        if (type_info.GetONNXType() != ONNX_TYPE_TENSOR || type_info.GetTensorTypeAndShapeInfo().GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32) {
+            std::cerr << "The model input " << name << " must be an int32 tensor." << std::endl;
+            
+            return false;
+        }
+        
+        this->input_names.push_back(name);
+        this->inputs.push_back(static_cast<ModelInput>(known));
+    }
+    
+    if (std::find(this->inputs.begin(), this->inputs.end(), INPUT_IDS) == this->inputs.end()) {
+        std::cerr << "The model has no input_ids input." << std::endl;
+        
+        return false;
+    }
+    
+    for (size_t i = 0;i < this->session->GetOutputCount();i++) {
+        this->output_names.push_back(this->session->GetOutputNameAllocated(i, allocator).get());
+    }
+    
+    if (this->output_names.empty()) {
+        std::cerr << "The model has no output." << std::endl;
+        
+        return false;
+    }
+    
+    for (const std::string &name : this->input_names) {
+        this->input_name_pointers.push_back(name.c_str());
+    }
+    
+    return true;
+}
+
+int Model::select_output(const size_t index) {
+    Ort::TypeInfo type_info = this->session->GetOutputTypeInfo(index);
+    
+    if (type_info.GetONNXType() != ONNX_TYPE_TENSOR || type_info.GetTensorTypeAndShapeInfo().GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+        std::cerr << "The model output " << this->output_names[index] << " must be a float tensor." << std::endl;
+        
+        return -1;
+    }
+    
+    std::vector<int64_t> shape = type_info.GetTensorTypeAndShapeInfo().GetShape();
+    
+    if ((shape.size() != 2 && shape.size() != 3) || (shape.back() > 0 && shape.back() != this->hidden_size)) {
+        std::cerr << "The model output " << this->output_names[index] << " must be of shape [batch, " << this->hidden_size << "] or [batch, seq, " << this->hidden_size << "]." << std::endl;
+        
+        return -1;
+    }
+    
+    this->output = index;
+    this->pooled_output = shape.size() == 2;
+    
+    return 0;
+}
+
+int Model::set_output(const std::string &name) {
+    size_t index = std::find(this->output_names.begin(), this->output_names.end(), name) - this->output_names.begin();
+    
+    if (index == this->output_names.size()) {
+        std::cerr << "Unknown model output " << name << "." << std::endl;
+        
+        return -1;
+    }
+    
+    if (this->select_output(index) != 0) {
+        return -1;
+    }
+    
+    this->binding->ClearBoundOutputs();
+    this->workspace.unbind();
+    
+    // The inputs are resolved once they have their names.
+    this->valid = !this->input_name_pointers.empty();
+    
+    return 0;
+}
+
+// The padding is masked out of the attention, so every embedding is the one of its sequence alone.
+// The session writes to the workspace, from which the embeddings are copied, the first token of the
+// token states.
+float Model::predict_batch(const std::vector<int32_t>* input_ids, const size_t batch_size, float* embeddings) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    size_t seq_length = 0;
+    
+    for (size_t b = 0;b < batch_size;b++) {
+        seq_length = std::max(seq_length, input_ids[b].size());
+    }
+    
+    if (!this->valid || batch_size == 0 || seq_length == 0) {
+        std::fill(embeddings, embeddings + batch_size * this->hidden_size, 0);
+        
+        return 0;
+    }
+    
+    if (this->workspace.prepare(input_ids, batch_size, !this->pooled_output, this->inputs.size() + 1)) {
+        this->ort_inputs.clear();
+        
+        for (size_t k = 0;k < this->inputs.size();k++) {
+            std::vector<int32_t> &values = this->workspace.input(this->inputs[k]);
+            
+            this->ort_inputs.emplace_back(Ort::Value::CreateTensor<int32_t>(this->memory_info, values.data(), values.size(), this->workspace.get_input_dims(), 2));
+            this->binding->BindInput(this->input_name_pointers[k], this->ort_inputs.back());
+        }
+        
+        this->output_tensor = Ort::Value::CreateTensor<float>(this->memory_info, this->workspace.output(), this->workspace.output_size(), this->workspace.get_output_dims(), this->workspace.output_rank());
+        this->binding->BindOutput(this->output_names[this->output].c_str(), this->output_tensor);
+    }
+    
+    this->session->Run(this->run_options, *this->binding);
+    this->workspace.extract(embeddings);
+    
+    float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    
+    return ms / 1000000;
+}
+
+Tokenizer::Tokenizer(std::string tokenizer_path, uint16_t max_seq_length) {
+    std::string str_tokenizer_model_path(tokenizer_path);
+
+    const auto status = this->tokenizer.Load(str_tokenizer_model_path);
+    
+    if (!status.ok()) {
+        std::cerr << status.ToString() << std::endl;
+    }
+    
+    this->max_seq_length = max_seq_length;
+}
+
+std::tuple<std::vector<int32_t>, float> Tokenizer::tokenize(std::string content) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    
+    if (!this->tokenizer.status().ok()) {
+        float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        
+        return std::tuple<std::vector<int32_t>, float>(std::vector<int32_t>(), ms / 1000000);
+    }
+    
+    std::vector<int32_t> input_ids;
+    
+    this->tokenizer.Encode(content, &input_ids);
+    
+    std::transform(input_ids.begin(), input_ids.end(), input_ids.begin(), [](int id){return id+1;});
+    
+    if (input_ids.size() > this->max_seq_length - 2) {
+        input_ids.resize(this->max_seq_length - 2);
+    }
+    
+    input_ids.push_back(2);
+    input_ids.push_back(0);
+    
+    std::rotate(input_ids.rbegin(), input_ids.rbegin() + 1, input_ids.rend());
+    
+    float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    
+    return std::tuple<std::vector<int32_t>, float>(input_ids, ms / 1000000);
+}
+
+SentenceEncoder::SentenceEncoder(const char* model_path, uint16_t hidden_size, const char* tokenizer_model_path, uint16_t max_seq_length) : model(model_path, hidden_size), tokenizer(tokenizer_model_path, max_seq_length) {
+}
@@ -0,0 +1,80 @@
+//
+//  model.hpp
+//
+
+#ifndef model_hpp
+#define model_hpp
+
+#include "sentencepiece_processor.hpp"
+#include "onnxruntime_cxx_api.h"
+#include "inference_workspace.hpp"
+#include "text_encoder.hpp"
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+class Tokenizer {
+    private:
+        sentencepiece::SentencePieceProcessor tokenizer;
+        uint16_t max_seq_length;
+    public:
+        Tokenizer(std::string tokenizer_model_path, uint16_t max_seq_length);
+        std::tuple<std::vector<int32_t>, float> tokenize(std::string text);
+};
+
+class Model {
+    private:
+        // <pad> in the vocabulary of the tokenizer, <s> being 0 and </s> 2.
+        static constexpr int32_t pad_token_id = 1;
+        
+        std::unique_ptr<Ort::Session> session;
+        std::unique_ptr<Ort::Env> env;
+        // Session metadata resolved once, the names in the order of the session.
+        std::vector<std::string> input_names;
+        std::vector<const char*> input_name_pointers;
+        std::vector<ModelInput> inputs;
+        std::vector<std::string> output_names;
+        // Output fetched, and whether it has one row per sequence rather than one per token.
+        size_t output = 0;
+        bool pooled_output = false;
+        Ort::MemoryInfo memory_info;
+        bool valid = false;
+        // The tensors over the workspace stay bound while it keeps their shape.
+        InferenceWorkspace workspace;
+        std::vector<Ort::Value> ort_inputs;
+        Ort::Value output_tensor;
+        std::unique_ptr<Ort::IoBinding> binding;
+        Ort::RunOptions run_options;
+        
+        bool resolve_metadata();
+        int select_output(const size_t index);
+    public:
+        uint16_t hidden_size;
+    
+        Model(std::string model_path, uint16_t hidden_size);
+        // Fetch only the named output, of shape [batch, hidden_size] or [batch, seq, hidden_size].
+        int set_output(const std::string &name);
+        // Write the embeddings of batch_size sequences, hidden_size floats each, from a single run
+        // padding them to the longest one, and return the inference time.
+        float predict_batch(const std::vector<int32_t>* input_ids, const size_t batch_size, float* embeddings);
+        // Times a buffer of the workspace had to grow or a tensor was created over one.
+        uint64_t get_allocations() const { return this->workspace.get_allocations(); }
+};
+
+// Texts tokenized by sentencepiece and embedded by the ONNX model.
+class SentenceEncoder : public TextEncoder {
+    private:
+        Model model;
+        Tokenizer tokenizer;
+    public:
+        SentenceEncoder(const char* model_path, uint16_t hidden_size, const char* tokenizer_model_path, uint16_t max_seq_length);
+        
+        uint16_t get_hidden_size() const override { return this->model.hidden_size; }
+        std::tuple<std::vector<int32_t>, float> tokenize(const std::string &text) override { return this->tokenizer.tokenize(text); }
+        float predict_batch(const std::vector<int32_t>* input_ids, const size_t batch_size, float* embeddings) override { return this->model.predict_batch(input_ids, batch_size, embeddings); }
+        int set_output(const std::string &name) override { return this->model.set_output(name); }
+        uint64_t get_allocations() const override { return this->model.get_allocations(); }
+};
+
+#endif /* model_hpp */
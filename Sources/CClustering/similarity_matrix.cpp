@@ -0,0 +1,286 @@
+//
+//  similarity_matrix.cpp
+//
+
+#include "similarity_matrix.hpp"
+
+
+constexpr float SimilarityRow::missing_similarity;
+
+SimilarityMatrix::SimilarityMatrix(const SimilarityStorage storage) {
+    this->storage = storage;
+}
+
+size_t SimilarityMatrix::memory_size() const {
+    size_t edges = 0;
+    
+    for (const std::vector<SimilarityEdge> &row : this->sparse) {
+        edges += row.capacity();
+    }
+    
+    return sizeof(float) * (this->dense.size() * this->dense.row_stride() + this->packed.capacity()) + sizeof(SimilarityEdge) * edges;
+}
+
+SimilarityRow SimilarityMatrix::operator[](const size_t i) const {
+    if (this->storage == DENSE_SIMILARITIES) {
+        return SimilarityRow(this->dense.row(i), nullptr, nullptr, i, this->items);
+    }
+    
+    if (this->storage == SPARSE_SIMILARITIES) {
+        return SimilarityRow(nullptr, nullptr, &this->sparse[i], i, this->items);
+    }
+    
+    return SimilarityRow(nullptr, this->packed.data(), nullptr, i, this->items);
+}
+
+float SimilarityMatrix::get(const size_t i, const size_t j) const {
+    if (this->storage == DENSE_SIMILARITIES) {
+        return this->dense.row(i)[j];
+    }
+    
+    if (this->storage == SPARSE_SIMILARITIES) {
+        return (*this)[i][j];
+    }
+    
+    return i <= j ? this->packed[kernels::packed_index(i, j)] : this->packed[kernels::packed_index(j, i)];
+}
+
+// Keep the edge ordered by item in the adjacency list of i, or drop it when under the floor.
+void SimilarityMatrix::set_edge(const size_t i, const size_t j, const float similarity) {
+    std::vector<SimilarityEdge> &row = this->sparse[i];
+    std::vector<SimilarityEdge>::iterator edge = std::lower_bound(row.begin(), row.end(), j, [](const SimilarityEdge &edge, const size_t item){ return edge.item < item; });
+    bool exists = edge != row.end() && edge->item == j;
+    
+    if (similarity >= this->floor || i == j) {
+        if (exists) {
+            edge->similarity = similarity;
+        } else {
+            row.insert(edge, SimilarityEdge{static_cast<uint32_t>(j), similarity});
+        }
+    } else if (exists) {
+        row.erase(edge);
+    }
+}
+
+void SimilarityMatrix::set(const size_t i, const size_t j, const float similarity) {
+    if (this->storage == DENSE_SIMILARITIES) {
+        this->dense.row(i)[j] = similarity;
+        this->dense.row(j)[i] = similarity;
+    } else if (this->storage == SPARSE_SIMILARITIES) {
+        this->set_edge(i, j, similarity);
+        
+        if (i != j) {
+            this->set_edge(j, i, similarity);
+        }
+    } else {
+        this->packed[i <= j ? kernels::packed_index(i, j) : kernels::packed_index(j, i)] = similarity;
+    }
+}
+
+// The dense storage copies them back from its lower triangle, the packed storage has no other copy so
+// they are computed again from the normalized embeddings.
+void SimilarityMatrix::restore(const size_t i, const Matrix &embeddings) {
+    if (this->storage == DENSE_SIMILARITIES) {
+        for (size_t j = 0;j < i;j++) {
+            this->dense.row(j)[i] = this->dense.row(i)[j];
+        }
+        
+        for (size_t j = i + 1;j < this->items;j++) {
+            this->dense.row(i)[j] = this->dense.row(j)[i];
+        }
+    } else {
+        for (size_t j = 0;j < this->items;j++) {
+            if (j != i) {
+                this->packed[i < j ? kernels::packed_index(i, j) : kernels::packed_index(j, i)] = kernels::dot_product(embeddings.row(i), embeddings.row(j), embeddings.columns());
+            }
+        }
+    }
+}
+
+// Switch to another storage. The similarities already computed are kept, except when leaving the
+// sparse storage or lowering its floor where the dropped similarities are recomputed from the
+// embeddings.
+void SimilarityMatrix::set_storage(const SimilarityStorage new_storage, const float new_floor, const Matrix &embeddings) {
+    if (new_storage == SPARSE_SIMILARITIES || this->storage == SPARSE_SIMILARITIES) {
+        bool keeps_edges = this->storage == SPARSE_SIMILARITIES && new_storage == SPARSE_SIMILARITIES && new_floor >= this->floor;
+        
+        this->floor = new_floor;
+        
+        if (keeps_edges) {
+            for (size_t i = 0;i < this->items;i++) {
+                std::vector<SimilarityEdge> &row = this->sparse[i];
+                
+                row.erase(std::remove_if(row.begin(), row.end(), [&](const SimilarityEdge &edge){ return edge.similarity < new_floor && edge.item != i; }), row.end());
+            }
+        } else {
+            this->storage = new_storage;
+            this->dense = Matrix();
+            std::vector<float>().swap(this->packed);
+            std::vector<std::vector<SimilarityEdge>>().swap(this->sparse);
+            this->compute(embeddings);
+        }
+        
+        return;
+    }
+    
+    this->floor = new_floor;
+    
+    if (new_storage == this->storage) {
+        return;
+    }
+    
+    if (new_storage == PACKED_SIMILARITIES) {
+        this->packed.assign(this->items * (this->items + 1) / 2, 0);
+        
+        for (size_t j = 0;j < this->items;j++) {
+            std::copy(this->dense.row(j), this->dense.row(j) + j + 1, this->packed.begin() + kernels::packed_index(0, j));
+        }
+        
+        this->dense = Matrix();
+    } else {
+        this->dense.reset(this->items, this->items);
+        
+        for (size_t i = 0;i < this->items;i++) {
+            for (size_t j = i;j < this->items;j++) {
+                this->dense.row(i)[j] = this->packed[kernels::packed_index(i, j)];
+                this->dense.row(j)[i] = this->packed[kernels::packed_index(i, j)];
+            }
+        }
+        
+        std::vector<float>().swap(this->packed);
+    }
+    
+    this->storage = new_storage;
+}
+
+// Recompute every similarity from the normalized embeddings.
+void SimilarityMatrix::compute(const Matrix &embeddings) {
+    static_assert(Matrix::simd_width % kernels::gram_padding == 0, "Matrix rows must be padded for the Gram matrix kernels");
+    
+    this->items = embeddings.size();
+    
+    if (this->storage == DENSE_SIMILARITIES) {
+        this->dense.reset(this->items, this->items);
+        
+        kernels::gram_matrix(embeddings.data(), embeddings.size(), embeddings.row_stride(), embeddings.row_stride(), this->dense.data(), this->dense.row_stride());
+    } else if (this->storage == SPARSE_SIMILARITIES) {
+        // Computed pair by pair so the dense matrix is never materialized, the rows are filled in
+        // item order so they stay sorted.
+        kernels::DotProductFunction dot_product = kernels::dot_product_function();
+        
+        this->sparse.assign(this->items, std::vector<SimilarityEdge>());
+        
+        for (size_t i = 0;i < this->items;i++) {
+            for (size_t j = i;j < this->items;j++) {
+                float similarity = dot_product(embeddings.row(i), embeddings.row(j), embeddings.columns());
+                
+                if (similarity >= this->floor || i == j) {
+                    this->sparse[i].push_back(SimilarityEdge{static_cast<uint32_t>(j), similarity});
+                    
+                    if (i != j) {
+                        this->sparse[j].push_back(SimilarityEdge{static_cast<uint32_t>(i), similarity});
+                    }
+                }
+            }
+        }
+    } else {
+        this->packed.assign(this->items * (this->items + 1) / 2, 0);
+        
+        kernels::packed_gram_matrix(embeddings.data(), embeddings.size(), embeddings.row_stride(), embeddings.row_stride(), this->packed.data());
+    }
+}
+
+// Shift the items of every edge at or after idx by offset, used when an item is inserted or erased.
+static void shift_edges(std::vector<std::vector<SimilarityEdge>> &sparse, const size_t idx, const int offset) {
+    for (std::vector<SimilarityEdge> &row : sparse) {
+        std::vector<SimilarityEdge>::iterator edge = std::lower_bound(row.begin(), row.end(), idx, [](const SimilarityEdge &edge, const size_t item){ return edge.item < item; });
+        
+        for (;edge != row.end();++edge) {
+            edge->item += offset;
+        }
+    }
+}
+
+// Insert a zero-filled item before idx.
+void SimilarityMatrix::insert(const size_t idx) {
+    this->insert(std::vector<size_t>(1, idx));
+}
+
+void SimilarityMatrix::insert(const std::vector<size_t> &positions) {
+    size_t new_items = this->items + positions.size();
+    
+    if (this->storage == DENSE_SIMILARITIES) {
+        this->dense.insert_columns(positions);
+        this->dense.insert_rows(positions);
+    } else if (this->storage == SPARSE_SIMILARITIES) {
+        for (std::vector<SimilarityEdge> &row : this->sparse) {
+            for (SimilarityEdge &edge : row) {
+                edge.item = inserted_position(positions, edge.item);
+            }
+        }
+        
+        insert_at_positions(this->sparse, positions, std::vector<SimilarityEdge>());
+    } else {
+        // Columns move right and get the new rows, walking from the last column so that every value
+        // is moved to a position after the ones still to move. New columns are zero-filled.
+        size_t m = positions.size();
+        size_t j = this->items;
+        
+        this->packed.resize(new_items * (new_items + 1) / 2);
+        
+        for (size_t new_j = new_items;new_j-- > 0;) {
+            float* new_column = this->packed.data() + kernels::packed_index(0, new_j);
+            
+            if (m > 0 && positions[m - 1] == new_j) {
+                std::fill(new_column, new_column + new_j + 1, 0);
+                m--;
+                continue;
+            }
+            
+            const float* old_column = this->packed.data() + kernels::packed_index(0, --j);
+            size_t i = j + 1;
+            size_t row_m = m;
+            
+            for (size_t new_i = new_j + 1;new_i-- > 0;) {
+                if (row_m > 0 && positions[row_m - 1] == new_i) {
+                    new_column[new_i] = 0;
+                    row_m--;
+                } else {
+                    new_column[new_i] = old_column[--i];
+                }
+            }
+        }
+    }
+    
+    this->items = new_items;
+}
+
+void SimilarityMatrix::erase(const size_t idx) {
+    if (this->storage == DENSE_SIMILARITIES) {
+        this->dense.erase_column(idx);
+        this->dense.erase_row(idx);
+    } else if (this->storage == SPARSE_SIMILARITIES) {
+        for (const SimilarityEdge &edge : this->sparse[idx]) {
+            if (edge.item != idx) {
+                std::vector<SimilarityEdge> &row = this->sparse[edge.item];
+                
+                row.erase(std::lower_bound(row.begin(), row.end(), idx, [](const SimilarityEdge &edge, const size_t item){ return edge.item < item; }));
+            }
+        }
+        
+        this->sparse.erase(this->sparse.begin() + idx);
+        shift_edges(this->sparse, idx, -1);
+    } else {
+        for (size_t j = idx;j + 1 < this->items;j++) {
+            float* old_column = this->packed.data() + kernels::packed_index(0, j + 1);
+            float* new_column = this->packed.data() + kernels::packed_index(0, j);
+            
+            std::copy(old_column, old_column + idx, new_column);
+            std::copy(old_column + idx + 1, old_column + j + 2, new_column + idx);
+        }
+        
+        this->packed.resize((this->items - 1) * this->items / 2);
+    }
+    
+    this->items--;
+}
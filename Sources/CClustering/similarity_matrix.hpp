@@ -0,0 +1,164 @@
+//
+//  similarity_matrix.hpp
+//
+
+#ifndef similarity_matrix_hpp
+#define similarity_matrix_hpp
+
+#include "matrix.hpp"
+#include "kernels.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+enum SimilarityStorage {
+    // Full n x n row-major matrix.
+    DENSE_SIMILARITIES = 0,
+    // Upper triangle only, packed column by column, half the memory of the dense storage.
+    PACKED_SIMILARITIES = 1,
+    // Adjacency lists keeping only the similarities at or above a floor, plus the diagonal.
+    SPARSE_SIMILARITIES = 2
+};
+
+struct SimilarityEdge {
+    uint32_t item;
+    float similarity;
+};
+
+struct SimilarityPair {
+    float similarity;
+    uint32_t item1;
+    uint32_t item2;
+};
+
+// Read-only view over the similarities of one item with every item, whatever the storage.
+class SimilarityRow {
+    private:
+        const float* dense_row;
+        const float* packed;
+        const std::vector<SimilarityEdge>* edges;
+        size_t i;
+        size_t items;
+    public:
+        // Value read for the similarities missing from the sparse storage, they are all below the floor.
+        static constexpr float missing_similarity = -1;
+        
+        class const_iterator {
+            private:
+                const SimilarityRow* row;
+                size_t j;
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef float value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const float* pointer;
+                typedef float reference;
+                
+                const_iterator(const SimilarityRow* row, const size_t j) : row(row), j(j) {}
+                float operator*() const { return (*this->row)[this->j]; }
+                const_iterator& operator++() { this->j++; return *this; }
+                const_iterator operator++(int) { const_iterator previous = *this; this->j++; return previous; }
+                bool operator==(const const_iterator &other) const { return this->j == other.j; }
+                bool operator!=(const const_iterator &other) const { return this->j != other.j; }
+        };
+        
+        SimilarityRow(const float* dense_row, const float* packed, const std::vector<SimilarityEdge>* edges, const size_t i, const size_t items) : dense_row(dense_row), packed(packed), edges(edges), i(i), items(items) {}
+        size_t size() const { return this->items; }
+        float back() const { return (*this)[this->items - 1]; }
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, this->items); }
+        
+        float operator[](const size_t j) const {
+            if (this->dense_row != nullptr) {
+                return this->dense_row[j];
+            }
+            
+            if (this->edges != nullptr) {
+                std::vector<SimilarityEdge>::const_iterator edge = std::lower_bound(this->edges->begin(), this->edges->end(), j, [](const SimilarityEdge &edge, const size_t item){ return edge.item < item; });
+                
+                return edge != this->edges->end() && edge->item == j ? edge->similarity : SimilarityRow::missing_similarity;
+            }
+            
+            return j <= this->i ? this->packed[kernels::packed_index(j, this->i)] : this->packed[kernels::packed_index(this->i, j)];
+        }
+};
+
+// Position of the item at i once the items at positions, sorted, are inserted: positions are those
+// of the inserted items once all are inserted, like in SimilarityMatrix::insert.
+inline size_t inserted_position(const std::vector<size_t> &positions, const size_t i) {
+    size_t low = 0;
+    size_t high = positions.size();
+    
+    // The m-th inserted item goes after positions[m] - m items already there.
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        
+        if (positions[middle] - middle <= i) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    return i + low;
+}
+
+// Insert value at positions in values, moving every other value once.
+template<typename T>
+void insert_at_positions(std::vector<T> &values, const std::vector<size_t> &positions, const T &value) {
+    size_t m = positions.size();
+    
+    values.resize(values.size() + positions.size());
+    
+    for (size_t i = values.size();i-- > 0 && m > 0;) {
+        if (positions[m - 1] == i) {
+            values[i] = value;
+            m--;
+        } else {
+            values[i] = std::move(values[i - m]);
+        }
+    }
+}
+
+// Symmetric item to item similarities, stored either as a dense matrix, as a packed upper
+// triangle or as a sparse graph thresholded at a floor. Items can be inserted or erased at any
+// position.
+class SimilarityMatrix {
+    private:
+        SimilarityStorage storage;
+        Matrix dense;
+        std::vector<float> packed;
+        std::vector<std::vector<SimilarityEdge>> sparse;
+        float floor = 0.3;
+        size_t items = 0;
+        
+        void set_edge(const size_t i, const size_t j, const float similarity);
+    public:
+        explicit SimilarityMatrix(const SimilarityStorage storage = DENSE_SIMILARITIES);
+        
+        SimilarityStorage get_storage() const { return this->storage; }
+        float get_floor() const { return this->floor; }
+        size_t size() const { return this->items; }
+        size_t memory_size() const;
+        SimilarityRow operator[](const size_t i) const;
+        const std::vector<SimilarityEdge>& edges(const size_t i) const { return this->sparse[i]; }
+        float get(const size_t i, const size_t j) const;
+        void set(const size_t i, const size_t j, const float similarity);
+        // Similarity of i < j that can be overwritten as scratch: the upper triangle of the dense
+        // storage, whose lower triangle still holds it, or the packed storage. Not for the sparse one.
+        float& scratch(const size_t i, const size_t j) { return this->storage == DENSE_SIMILARITIES ? this->dense.row(i)[j] : this->packed[kernels::packed_index(i, j)]; }
+        // Put back the similarities of item i overwritten through scratch.
+        void restore(const size_t i, const Matrix &embeddings);
+        
+        void set_storage(const SimilarityStorage new_storage, const float new_floor, const Matrix &embeddings);
+        void compute(const Matrix &embeddings);
+        void insert(const size_t idx);
+        // Insert zero-filled items at positions, sorted, which are their positions once all are
+        // inserted. Every similarity already there is moved once.
+        void insert(const std::vector<size_t> &positions);
+        void erase(const size_t idx);
+};
+
+#endif /* similarity_matrix_hpp */
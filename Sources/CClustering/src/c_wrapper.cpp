@@ -5,38 +5,176 @@
 //
 
 #include "../clustering.hpp"
+#include "../model.hpp"
+#include "../include/result_abi.hpp"
 
 
 extern "C" void* createClustering(const float threshold, const char* model_path, uint16_t hidden_size, const char* tokenizer_model_path, uint16_t max_seq_length) {
-    Clustering* clustering = new Clustering(threshold, model_path, hidden_size, tokenizer_model_path, max_seq_length);
+    Clustering* clustering = new Clustering(threshold, std::make_unique<SentenceEncoder>(model_path, hidden_size, tokenizer_model_path, max_seq_length));
     
     return (void*) clustering;
 }
 
-extern "C" int add_textual_item(void* handle, const char* text, const int idx, struct ClusteringResult* result) {
+extern "C" int add_textual_item(void* handle, const char* text, const int idx, ClusteringResult* result) {
     Clustering* clustering = (Clustering*)handle;
     
     return clustering->add_textual_item(text, idx, result);
 }
 
-extern "C" int remove_textual_item(void* handle, const int idx, const int from_add, struct ClusteringResult* result) {
+extern "C" int add_textual_items(void* handle, const char** texts, const int* idxs, const int count, ClusteringResult* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->add_textual_items(texts, idxs, count, result);
+}
+
+extern "C" int remove_textual_item(void* handle, const int idx, const int from_add, ClusteringResult* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->remove_textual_item(idx, from_add, result);
+}
+
+extern "C" int recompute_clustering_threshold(void* handle, const ClusterDefinition* expected_clusters, ClusteringResult* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->recompute_clustering_threshold(expected_clusters, result);
+}
+
+extern "C" int add_textual_item_v2(void* handle, const char* text, const int idx, ClusteringResultV2* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->add_textual_item(text, idx, result);
+}
+
+extern "C" int add_textual_items_v2(void* handle, const char** texts, const int* idxs, const int count, ClusteringResultV2* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->add_textual_items(texts, idxs, count, result);
+}
+
+extern "C" int remove_textual_item_v2(void* handle, const int idx, const int from_add, ClusteringResultV2* result) {
     Clustering* clustering = (Clustering*)handle;
     
     return clustering->remove_textual_item(idx, from_add, result);
 }
 
-extern "C" int recompute_clustering_threshold(void* handle, const struct ClusterDefinition* expected_clusters, struct ClusteringResult* result) {
+extern "C" int recompute_clustering_threshold_v2(void* handle, const ClusterDefinitionV2* expected_clusters, ClusteringResultV2* result) {
     Clustering* clustering = (Clustering*)handle;
     
     return clustering->recompute_clustering_threshold(expected_clusters, result);
 }
 
+extern "C" int add_textual_item_delta(void* handle, const char* text, const int idx, ClusteringDeltaResult* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->add_textual_item(text, idx, result);
+}
+
+extern "C" int add_textual_items_delta(void* handle, const char** texts, const int* idxs, const int count, ClusteringDeltaResult* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->add_textual_items(texts, idxs, count, result);
+}
+
+extern "C" int remove_textual_item_delta(void* handle, const int idx, const int from_add, ClusteringDeltaResult* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->remove_textual_item(idx, from_add, result);
+}
+
+extern "C" int get_result_abi_version(void) {
+    return CLUSTERING_RESULT_ABI_VERSION;
+}
+
 extern "C" float get_threshold(void* handle) {
     Clustering* clustering = (Clustering*)handle;
     
     return clustering->get_threshold();
 }
 
+extern "C" int set_clustering_strategy(void* handle, const int strategy) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_clustering_strategy(static_cast<ClusteringStrategy>(strategy));
+}
+
+extern "C" int set_consistency_check(void* handle, const int enabled) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_consistency_check(enabled != 0);
+}
+
+extern "C" int set_similarity_storage(void* handle, const int storage) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_similarity_storage(static_cast<SimilarityStorage>(storage));
+}
+
+extern "C" int set_sparse_similarity_floor(void* handle, const float floor) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_sparse_similarity_floor(floor);
+}
+
+extern "C" int set_neighbor_index(void* handle, const uint16_t m, const uint16_t ef_construction, const uint16_t ef_search) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_neighbor_index(m, ef_construction, ef_search);
+}
+
+extern "C" int set_calibration_threads(void* handle, const uint16_t threads) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_calibration_threads(threads);
+}
+
+extern "C" int set_centroid_fast_path(void* handle, const float band) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_centroid_fast_path(band);
+}
+
+extern "C" int get_centroid_fast_path_stats(void* handle, uint64_t* hits, uint64_t* misses) {
+    Clustering* clustering = (Clustering*)handle;
+    std::tuple<uint64_t, uint64_t> stats = clustering->get_centroid_fast_path_stats();
+    
+    *hits = std::get<0>(stats);
+    *misses = std::get<1>(stats);
+    
+    return 0;
+}
+
+extern "C" int set_inference_scheduling(void* handle, const uint16_t* boundaries, const int boundaries_size, const uint32_t max_batch_tokens) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_inference_scheduling(std::vector<uint16_t>(boundaries, boundaries + boundaries_size), max_batch_tokens);
+}
+
+extern "C" int get_inference_stats(void* handle, InferenceStats* stats) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    *stats = clustering->get_inference_stats();
+    
+    return 0;
+}
+
+extern "C" int set_model_output(void* handle, const char* name) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->set_model_output(name);
+}
+
+extern "C" int clusters_at_threshold(void* handle, const float threshold, ClusteringResult* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->clusters_at_threshold(threshold, result);
+}
+
+extern "C" int clusters_at_threshold_v2(void* handle, const float threshold, ClusteringResultV2* result) {
+    Clustering* clustering = (Clustering*)handle;
+    
+    return clustering->clusters_at_threshold(threshold, result);
+}
+
 extern "C" void removeClustering(void* handle) {
     Clustering* clustering = (Clustering*)handle;
     
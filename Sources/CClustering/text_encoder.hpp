@@ -0,0 +1,32 @@
+//
+//  text_encoder.hpp
+//
+
+#ifndef text_encoder_hpp
+#define text_encoder_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Tokenizes the texts and infers their embeddings for the clustering, which does not depend on the
+// model behind it.
+class TextEncoder {
+    public:
+        virtual ~TextEncoder() {}
+        
+        virtual uint16_t get_hidden_size() const = 0;
+        // Token ids of the text, and the time taken.
+        virtual std::tuple<std::vector<int32_t>, float> tokenize(const std::string &text) = 0;
+        // Write the embeddings of batch_size sequences, hidden_size floats each, from a single
+        // inference and return the inference time.
+        virtual float predict_batch(const std::vector<int32_t>* input_ids, const size_t batch_size, float* embeddings) = 0;
+        // Fetch the named output of the model as the embeddings.
+        virtual int set_output(const std::string &name) = 0;
+        // Times a buffer of the inference had to grow or a tensor was created over one.
+        virtual uint64_t get_allocations() const = 0;
+};
+
+#endif /* text_encoder_hpp */
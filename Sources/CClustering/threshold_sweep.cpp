@@ -0,0 +1,546 @@
+//
+//  threshold_sweep.cpp
+//
+
+#include "threshold_sweep.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+constexpr uint32_t ThresholdSweep::no_owner;
+
+// A threshold strictly between two consecutive breakpoints, none when they are adjacent floats.
+static bool between(const float low, const float high, float &threshold) {
+    threshold = float((double(low) + double(high)) / 2);
+    
+    if (threshold <= low) {
+        threshold = std::nextafter(low, high);
+    }
+    
+    return threshold < high;
+}
+
+// Order of the greedy candidates: by decreasing length, then by row with the null cluster last.
+static bool precedes(const uint32_t candidate1, const uint32_t length1, const uint32_t candidate2, const uint32_t length2) {
+    return length1 > length2 || (length1 == length2 && candidate1 < candidate2);
+}
+
+ThresholdSweep::ThresholdSweep(const SimilarityMatrix &similarities, const std::vector<bool> &null_items, const float floor, const uint16_t threads) : first_pair(0), null_items(null_items), floor(floor), threads(std::max<uint16_t>(threads, 1)), perfect_segment(0) {
+    for (uint32_t i = 0;i < similarities.size();i++) {
+        if (this->null_items[i]) {
+            this->null_members.push_back(i);
+            continue;
+        }
+        
+        if (similarities.get_storage() == SPARSE_SIMILARITIES) {
+            for (const SimilarityEdge &edge : similarities.edges(i)) {
+                if (edge.item >= i && edge.similarity > floor && !this->null_items[edge.item]) {
+                    this->pairs.push_back(SimilarityPair{edge.similarity, i, edge.item});
+                }
+            }
+            
+            continue;
+        }
+        
+        SimilarityRow row = similarities[i];
+        
+        for (uint32_t j = i;j < row.size();j++) {
+            float similarity = row[j];
+            
+            if (similarity > floor && !this->null_items[j]) {
+                this->pairs.push_back(SimilarityPair{similarity, i, j});
+            }
+        }
+    }
+    
+    this->sort_pairs();
+}
+
+ThresholdSweep::ThresholdSweep(const std::vector<SimilarityPair> &pairs, const std::vector<bool> &null_items, const float floor, const uint16_t threads) : first_pair(0), null_items(null_items), floor(floor), threads(std::max<uint16_t>(threads, 1)), perfect_segment(0) {
+    for (uint32_t i = 0;i < this->null_items.size();i++) {
+        if (this->null_items[i]) {
+            this->null_members.push_back(i);
+        }
+    }
+    
+    for (const SimilarityPair &pair : pairs) {
+        if (pair.similarity > floor && !this->null_items[pair.item1] && !this->null_items[pair.item2]) {
+            this->pairs.push_back(pair);
+        }
+    }
+    
+    this->sort_pairs();
+}
+
+void ThresholdSweep::sort_pairs() {
+    std::sort(this->pairs.begin(), this->pairs.end(), [](const SimilarityPair &a, const SimilarityPair &b){ return a.similarity > b.similarity; });
+    
+    while (this->first_pair < this->pairs.size() && this->pairs[this->first_pair].similarity >= 1) {
+        this->first_pair++;
+    }
+}
+
+// Positions where both encodings have the same cluster number are the overlaps of the k-th
+// cluster of each, so the accuracy is computed from the sizes alone.
+float ThresholdSweep::accuracy(const std::vector<uint32_t> &clusters_size, const std::vector<uint32_t> &expected_size) const {
+    size_t start = 0;
+    size_t expected_start = 0;
+    size_t matches = 0;
+    
+    for (size_t k = 0;k < std::min(clusters_size.size(), expected_size.size());k++) {
+        size_t end = start + clusters_size[k];
+        size_t expected_end = expected_start + expected_size[k];
+        
+        matches += std::max(std::min(end, expected_end), std::max(start, expected_start)) - std::max(start, expected_start);
+        start = end;
+        expected_start = expected_end;
+    }
+    
+    return this->null_items.size() > 0 ? matches / float(this->null_items.size()) : 0;
+}
+
+// Segments of about the same number of pairs under 1, one per thread, by increasing thresholds.
+// The pairs of a same similarity stay in the same segment.
+void ThresholdSweep::split_segments() {
+    size_t count = std::max<size_t>(std::min<size_t>(this->threads, this->pairs.size() - this->first_pair), 1);
+    size_t end = this->pairs.size();
+    
+    this->segments.clear();
+    
+    for (size_t k = 1;k <= count;k++) {
+        size_t begin = std::min(end, this->pairs.size() - (this->pairs.size() - this->first_pair) * k / count);
+        
+        while (begin > this->first_pair && this->pairs[begin - 1].similarity == this->pairs[begin].similarity) {
+            begin--;
+        }
+        
+        if (begin < end || this->segments.empty()) {
+            this->segments.push_back(Segment{begin, end, {}, true});
+            end = begin;
+        }
+    }
+}
+
+// Every worker takes the next segment until none is left, the calling thread being one of them.
+void ThresholdSweep::sweep_segments(const std::function<void(const size_t)> &sweep_segment) {
+    std::atomic<size_t> next_segment(0);
+    std::vector<std::thread> workers;
+    auto work = [this, &next_segment, &sweep_segment]() {
+        for (size_t segment = next_segment++;segment < this->segments.size();segment = next_segment++) {
+            sweep_segment(segment);
+        }
+    };
+    
+    this->perfect_segment = this->segments.size();
+    
+    for (size_t k = 1;k < std::min<size_t>(this->threads, this->segments.size());k++) {
+        workers.emplace_back(work);
+    }
+    
+    work();
+    
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+bool ThresholdSweep::cancelled(const size_t segment) const {
+    return this->perfect_segment.load(std::memory_order_relaxed) < segment;
+}
+
+// Once a segment holds a perfect run closed above, the best run is found under its top, so the
+// workers of the segments above can stop.
+void ThresholdSweep::found_perfect(const size_t segment) {
+    size_t perfect_segment = this->perfect_segment.load();
+    
+    while (segment < perfect_segment && !this->perfect_segment.compare_exchange_weak(perfect_segment, segment)) {}
+}
+
+// Join the runs of the segments, those of neighbor segments overlapping on the clusters at their
+// boundary, and keep the lowest run of best accuracy. The threshold of the greedy clusters must
+// be strictly inside the run, the one of the connected components may be at its top. The
+// segments after a perfect run closed above are not needed, so cancelled ones are never reached.
+std::tuple<float, float> ThresholdSweep::best_run(const bool inclusive) const {
+    float best_threshold = 0;
+    float best_accuracy = 0;
+    float threshold;
+    AccuracyRun run = this->segments[0].runs[0];
+    auto evaluate = [&](const AccuracyRun &run) {
+        if (run.accuracy > best_accuracy && (between(run.low, run.high, threshold) || inclusive)) {
+            best_threshold = std::min(threshold, run.high);
+            best_accuracy = run.accuracy;
+        }
+        
+        return best_accuracy == 1;
+    };
+    
+    for (const Segment &segment : this->segments) {
+        for (const AccuracyRun &next : segment.runs) {
+            if (next.accuracy == run.accuracy) {
+                run.high = std::max(run.high, next.high);
+                continue;
+            }
+            
+            if (evaluate(run)) {
+                return std::make_tuple(best_threshold, best_accuracy);
+            }
+            
+            run = next;
+        }
+    }
+    
+    evaluate(run);
+    
+    return std::make_tuple(best_threshold, best_accuracy);
+}
+
+// Rows by decreasing similarity: at any threshold, the members of a row are a prefix of it.
+void ThresholdSweep::build_rows() {
+    uint32_t items = this->null_items.size();
+    std::vector<size_t> row_ends;
+    
+    this->row_offsets.assign(items + 1, 0);
+    
+    for (const SimilarityPair &pair : this->pairs) {
+        this->row_offsets[pair.item1 + 1]++;
+        this->row_offsets[pair.item2 + 1] += pair.item1 != pair.item2;
+    }
+    
+    std::partial_sum(this->row_offsets.begin(), this->row_offsets.end(), this->row_offsets.begin());
+    row_ends.assign(this->row_offsets.begin(), this->row_offsets.end() - 1);
+    this->row_members.resize(this->row_offsets.back());
+    this->row_similarities.resize(this->row_offsets.back());
+    
+    for (const SimilarityPair &pair : this->pairs) {
+        this->row_members[row_ends[pair.item1]] = pair.item2;
+        this->row_similarities[row_ends[pair.item1]++] = pair.similarity;
+        
+        if (pair.item1 != pair.item2) {
+            this->row_members[row_ends[pair.item2]] = pair.item1;
+            this->row_similarities[row_ends[pair.item2]++] = pair.similarity;
+        }
+    }
+}
+
+// The null cluster is the candidate numbered after the last row.
+uint32_t ThresholdSweep::candidate_length(const GreedyState &state, const uint32_t candidate) const {
+    return candidate < this->null_items.size() ? state.row_lengths[candidate] : this->null_members.size();
+}
+
+// Same clusters as the greedy strategy of Clustering, from scratch.
+void ThresholdSweep::greedy_clusters(GreedyState &state) const {
+    uint32_t items = this->null_items.size();
+    
+    state.candidate_order.resize(items + 1);
+    state.candidate_positions.resize(items + 1);
+    std::iota(state.candidate_order.begin(), state.candidate_order.end(), 0);
+    std::sort(state.candidate_order.begin(), state.candidate_order.end(), [this, &state](const uint32_t candidate1, const uint32_t candidate2){ return precedes(candidate1, this->candidate_length(state, candidate1), candidate2, this->candidate_length(state, candidate2)); });
+    
+    state.extracted_items.assign(items, false);
+    state.owned_items.assign(items + 1, 0);
+    state.item_owners.assign(items, ThresholdSweep::no_owner);
+    
+    for (uint32_t position = 0;position <= items;position++) {
+        uint32_t candidate = state.candidate_order[position];
+        const uint32_t* members = candidate < items ? this->row_members.data() + this->row_offsets[candidate] : this->null_members.data();
+        
+        state.candidate_positions[candidate] = position;
+        
+        for (size_t k = 0;k < this->candidate_length(state, candidate);k++) {
+            if (!state.extracted_items[members[k]]) {
+                state.extracted_items[members[k]] = true;
+                state.item_owners[members[k]] = candidate;
+                state.owned_items[candidate]++;
+            }
+        }
+    }
+}
+
+std::vector<uint32_t> ThresholdSweep::greedy_clusters_size(const GreedyState &state) const {
+    std::vector<uint32_t> clusters_size;
+    
+    for (const uint32_t candidate : state.candidate_order) {
+        if (state.owned_items[candidate] > 0) {
+            clusters_size.push_back(state.owned_items[candidate]);
+        }
+    }
+    
+    return clusters_size;
+}
+
+// An item is extracted by the first candidate holding it. The similarities are symmetric, so the
+// candidates holding a non null item are the members of its own row.
+bool ThresholdSweep::reassign(GreedyState &state, const uint32_t item) const {
+    const uint32_t* holders = this->row_members.data() + this->row_offsets[item];
+    uint32_t owner = ThresholdSweep::no_owner;
+    uint32_t previous_owner = state.item_owners[item];
+    
+    for (size_t k = 0;k < state.row_lengths[item];k++) {
+        if (owner == ThresholdSweep::no_owner || precedes(holders[k], state.row_lengths[holders[k]], owner, state.row_lengths[owner])) {
+            owner = holders[k];
+        }
+    }
+    
+    if (owner == previous_owner) {
+        return false;
+    }
+    
+    if (previous_owner != ThresholdSweep::no_owner) {
+        state.owned_items[previous_owner]--;
+    }
+    
+    if (owner != ThresholdSweep::no_owner) {
+        state.owned_items[owner]++;
+    }
+    
+    state.item_owners[item] = owner;
+    
+    return true;
+}
+
+// Move a row that lost members later in the greedy order, past the candidates now coming before
+// it, and tell whether the clusters changed. The other candidates holding the items of the row
+// came after it, so each item goes to the first candidate passed holding it, and two clusters swap
+// when both extract items.
+bool ThresholdSweep::move_row(GreedyState &state, const uint32_t row) const {
+    uint32_t items = this->null_items.size();
+    uint32_t start = state.candidate_positions[row];
+    uint32_t position = start;
+    bool changed = false;
+    
+    for (;position < items && precedes(state.candidate_order[position + 1], this->candidate_length(state, state.candidate_order[position + 1]), row, state.row_lengths[row]);position++) {
+        state.candidate_order[position] = state.candidate_order[position + 1];
+        state.candidate_positions[state.candidate_order[position]] = position;
+    }
+    
+    state.candidate_order[position] = row;
+    state.candidate_positions[row] = position;
+    
+    for (uint32_t passed = start;passed < position && state.owned_items[row] > 0;passed++) {
+        uint32_t candidate = state.candidate_order[passed];
+        
+        changed |= state.owned_items[candidate] > 0;
+        
+        // The null cluster only holds null items.
+        if (candidate == items) {
+            continue;
+        }
+        
+        const uint32_t* members = this->row_members.data() + this->row_offsets[candidate];
+        
+        for (size_t k = 0;k < state.row_lengths[candidate];k++) {
+            if (state.item_owners[members[k]] == row) {
+                state.item_owners[members[k]] = candidate;
+                state.owned_items[row]--;
+                state.owned_items[candidate]++;
+                changed = true;
+            }
+        }
+    }
+    
+    return changed;
+}
+
+// The sweep goes up: crossing a similarity drops its pairs from their rows. A row extracting one
+// of these pairs gives it to another candidate, and the rows only move later in the greedy order.
+void ThresholdSweep::greedy_segment(const size_t index, const std::vector<uint32_t> &expected_size) {
+    Segment &segment = this->segments[index];
+    GreedyState state;
+    uint32_t items = this->null_items.size();
+    float run_low = segment.end < this->pairs.size() ? this->pairs[segment.end].similarity : this->floor;
+    
+    // The rows at the bottom of the segment keep their similarities above it.
+    state.row_lengths.resize(items);
+    state.moving_rows.assign(items, false);
+    
+    for (uint32_t i = 0;i < items;i++) {
+        const float* row_start = this->row_similarities.data() + this->row_offsets[i];
+        const float* row_end = this->row_similarities.data() + this->row_offsets[i + 1];
+        
+        state.row_lengths[i] = std::partition_point(row_start, row_end, [run_low](const float similarity){ return similarity > run_low; }) - row_start;
+    }
+    
+    this->greedy_clusters(state);
+    
+    float run_accuracy = this->accuracy(this->greedy_clusters_size(state), expected_size);
+    float threshold;
+    size_t remaining = segment.end;
+    
+    while (remaining > segment.begin) {
+        if (this->cancelled(index)) {
+            segment.complete = false;
+            return;
+        }
+        
+        float value = this->pairs[remaining - 1].similarity;
+        bool changed = false;
+        size_t crossed = remaining;
+        
+        state.moved_rows.clear();
+        
+        while (remaining > segment.begin && this->pairs[remaining - 1].similarity == value) {
+            const SimilarityPair &pair = this->pairs[--remaining];
+            
+            for (const uint32_t row : {pair.item1, pair.item2}) {
+                if (!state.moving_rows[row]) {
+                    state.moving_rows[row] = true;
+                    state.moved_rows.push_back(row);
+                }
+            }
+            
+            state.row_lengths[pair.item1]--;
+            state.row_lengths[pair.item2] -= pair.item1 != pair.item2;
+        }
+        
+        for (size_t k = remaining;k < crossed;k++) {
+            const SimilarityPair &pair = this->pairs[k];
+            
+            if (state.item_owners[pair.item2] == pair.item1) {
+                changed |= this->reassign(state, pair.item2);
+            }
+            
+            if (state.item_owners[pair.item1] == pair.item2) {
+                changed |= this->reassign(state, pair.item1);
+            }
+        }
+        
+        // From the last one, so that every row moves among candidates already in order.
+        std::sort(state.moved_rows.begin(), state.moved_rows.end(), [&state](const uint32_t row1, const uint32_t row2){ return state.candidate_positions[row1] > state.candidate_positions[row2]; });
+        
+        for (const uint32_t row : state.moved_rows) {
+            changed |= this->move_row(state, row);
+            state.moving_rows[row] = false;
+        }
+        
+        if (!changed) {
+            continue;
+        }
+        
+        float accuracy = this->accuracy(this->greedy_clusters_size(state), expected_size);
+        
+        if (accuracy == run_accuracy) {
+            continue;
+        }
+        
+        // The previous clusters hold for every threshold strictly between run_low and value.
+        segment.runs.push_back(AccuracyRun{run_low, value, run_accuracy});
+        
+        if (run_accuracy == 1 && between(run_low, value, threshold)) {
+            segment.runs.push_back(AccuracyRun{value, value, accuracy});
+            this->found_perfect(index);
+            return;
+        }
+        
+        run_low = value;
+        run_accuracy = accuracy;
+    }
+    
+    segment.runs.push_back(AccuracyRun{run_low, segment.begin > this->first_pair ? this->pairs[segment.begin - 1].similarity : 1, run_accuracy});
+}
+
+std::tuple<float, float> ThresholdSweep::greedy(const std::vector<uint32_t> &expected_size) {
+    this->build_rows();
+    this->split_segments();
+    this->sweep_segments([this, &expected_size](const size_t segment){ this->greedy_segment(segment, expected_size); });
+    
+    return this->best_run(false);
+}
+
+// Sizes of the components of the non null items and of the null cluster, by decreasing size.
+// Their order among a same size does not change the accuracy.
+std::vector<uint32_t> ThresholdSweep::component_clusters_size(const ComponentState &state) const {
+    std::vector<uint32_t> clusters_size;
+    
+    for (size_t size = state.size_counts.size() - 1;size > 0;size--) {
+        clusters_size.insert(clusters_size.end(), state.size_counts[size] + (size == this->null_members.size()), size);
+    }
+    
+    return clusters_size;
+}
+
+// Unite two components, keeping the count of components of every size.
+bool ThresholdSweep::unite(ComponentState &state, const uint32_t item1, const uint32_t item2) const {
+    uint32_t root1 = state.components.find(item1);
+    uint32_t root2 = state.components.find(item2);
+    
+    if (root1 == root2) {
+        return false;
+    }
+    
+    uint32_t size = state.component_sizes[root1] + state.component_sizes[root2];
+    
+    state.size_counts[state.component_sizes[root1]]--;
+    state.size_counts[state.component_sizes[root2]]--;
+    state.size_counts[size]++;
+    state.components.unite(root1, root2);
+    state.component_sizes[state.components.find(root1)] = size;
+    
+    return true;
+}
+
+// The sweep goes down: crossing a similarity unites its pairs, and the components only change
+// when a pair joins two of them, at most once per item.
+void ThresholdSweep::component_segment(const size_t index, const std::vector<uint32_t> &expected_size) {
+    Segment &segment = this->segments[index];
+    ComponentState state;
+    uint32_t items = this->null_items.size();
+    
+    state.components.reset(items);
+    state.component_sizes.assign(items, 1);
+    state.size_counts.assign(items + 1, 0);
+    state.size_counts[1] = items - this->null_members.size();
+    
+    // The components at the top of the segment, the similarities at 1 being above every threshold.
+    for (size_t k = 0;k < segment.begin;k++) {
+        this->unite(state, this->pairs[k].item1, this->pairs[k].item2);
+    }
+    
+    float run_high = segment.begin > this->first_pair ? this->pairs[segment.begin - 1].similarity : 1;
+    float run_accuracy = this->accuracy(this->component_clusters_size(state), expected_size);
+    size_t next = segment.begin;
+    
+    while (next < segment.end) {
+        if (this->cancelled(index)) {
+            segment.complete = false;
+            return;
+        }
+        
+        float value = this->pairs[next].similarity;
+        bool changed = false;
+        
+        for (;next < segment.end && this->pairs[next].similarity == value;next++) {
+            changed |= this->unite(state, this->pairs[next].item1, this->pairs[next].item2);
+        }
+        
+        if (!changed) {
+            continue;
+        }
+        
+        float accuracy = this->accuracy(this->component_clusters_size(state), expected_size);
+        
+        if (accuracy == run_accuracy) {
+            continue;
+        }
+        
+        // The previous components hold for every threshold above value and up to run_high.
+        segment.runs.push_back(AccuracyRun{value, run_high, run_accuracy});
+        
+        if (accuracy == 1) {
+            this->found_perfect(index);
+        }
+        
+        run_high = value;
+        run_accuracy = accuracy;
+    }
+    
+    segment.runs.push_back(AccuracyRun{segment.end < this->pairs.size() ? this->pairs[segment.end].similarity : this->floor, run_high, run_accuracy});
+    std::reverse(segment.runs.begin(), segment.runs.end());
+}
+
+std::tuple<float, float> ThresholdSweep::connected_components(const std::vector<uint32_t> &expected_size) {
+    this->split_segments();
+    this->sweep_segments([this, &expected_size](const size_t segment){ this->component_segment(segment, expected_size); });
+    
+    return this->best_run(true);
+}
@@ -0,0 +1,115 @@
+//
+//  threshold_sweep.hpp
+//
+
+#ifndef threshold_sweep_hpp
+#define threshold_sweep_hpp
+
+#include "similarity_matrix.hpp"
+#include "union_find.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+// Search for the threshold whose clusters best match expected ones. The clusters only change when
+// the threshold crosses a similarity, so the distinct similarities above the floor are sorted once
+// and the sweep goes from one to the next, updating the clusters with the pairs it crosses instead
+// of clustering again for every threshold. The accuracy is the share of positions where the result
+// and the expected clusters, encoded as in the results, have the same cluster number.
+//
+// The similarities are split into segments of thresholds swept by a pool of threads, every worker
+// rebuilding the clusters at the start of its segment in its own state. The sweep only reads the
+// pairs copied at construction, so it does not depend on the clustering once built.
+class ThresholdSweep {
+    private:
+        // Owner of the items no candidate holds.
+        static constexpr uint32_t no_owner = UINT32_MAX;
+        
+        // Thresholds from low to high over which the clusters keep the same accuracy.
+        struct AccuracyRun {
+            float low;
+            float high;
+            float accuracy;
+        };
+        
+        // The pairs from begin to end swept by one worker, and the accuracy runs it found by
+        // increasing thresholds. A segment is not complete when its worker was cancelled.
+        struct Segment {
+            size_t begin;
+            size_t end;
+            std::vector<AccuracyRun> runs;
+            bool complete;
+        };
+        
+        // Greedy clusters of a worker. The members of a row are the prefix of row_members of length
+        // row_lengths. candidate_order holds every candidate in the greedy order, owned_items how
+        // many items each extracted and item_owners the candidate that extracted every item.
+        struct GreedyState {
+            std::vector<uint32_t> row_lengths;
+            std::vector<uint32_t> owned_items;
+            std::vector<uint32_t> item_owners;
+            std::vector<uint32_t> candidate_order;
+            std::vector<uint32_t> candidate_positions;
+            std::vector<bool> extracted_items;
+            std::vector<bool> moving_rows;
+            std::vector<uint32_t> moved_rows;
+        };
+        
+        // Connected components of a worker, with the count of components of every size.
+        struct ComponentState {
+            UnionFind components;
+            std::vector<uint32_t> component_sizes;
+            std::vector<uint32_t> size_counts;
+        };
+        
+        // Pairs of non null items above the floor, diagonal included, by decreasing similarity.
+        // The workers only read them, along with the null items and the rows.
+        std::vector<SimilarityPair> pairs;
+        // First pair under 1, the ones before are above every threshold.
+        size_t first_pair;
+        std::vector<bool> null_items;
+        std::vector<uint32_t> null_members;
+        float floor;
+        uint16_t threads;
+        std::vector<size_t> row_offsets;
+        std::vector<uint32_t> row_members;
+        std::vector<float> row_similarities;
+        std::vector<Segment> segments;
+        // Lowest segment where a worker found a perfect accuracy, the segments above are cancelled.
+        std::atomic<size_t> perfect_segment;
+        
+        float accuracy(const std::vector<uint32_t> &clusters_size, const std::vector<uint32_t> &expected_size) const;
+        void split_segments();
+        void sweep_segments(const std::function<void(const size_t)> &sweep_segment);
+        bool cancelled(const size_t segment) const;
+        void found_perfect(const size_t segment);
+        std::tuple<float, float> best_run(const bool inclusive) const;
+        void build_rows();
+        uint32_t candidate_length(const GreedyState &state, const uint32_t candidate) const;
+        void greedy_clusters(GreedyState &state) const;
+        std::vector<uint32_t> greedy_clusters_size(const GreedyState &state) const;
+        bool reassign(GreedyState &state, const uint32_t item) const;
+        bool move_row(GreedyState &state, const uint32_t row) const;
+        void greedy_segment(const size_t segment, const std::vector<uint32_t> &expected_size);
+        bool unite(ComponentState &state, const uint32_t item1, const uint32_t item2) const;
+        std::vector<uint32_t> component_clusters_size(const ComponentState &state) const;
+        void component_segment(const size_t segment, const std::vector<uint32_t> &expected_size);
+        void sort_pairs();
+    public:
+        ThresholdSweep(const SimilarityMatrix &similarities, const std::vector<bool> &null_items, const float floor, const uint16_t threads = 1);
+        // Sweep given pairs instead of the similarities, for connected_components only. Uniting them
+        // by decreasing similarity must give the clusters of every threshold, like the merges of a
+        // dendrogram.
+        ThresholdSweep(const std::vector<SimilarityPair> &pairs, const std::vector<bool> &null_items, const float floor, const uint16_t threads = 1);
+        
+        // Best threshold above the floor and its accuracy, the lowest one on a tie. The threshold
+        // is taken in the middle of the range of thresholds giving that accuracy, and is 0 when no
+        // threshold gets any position right. The result does not depend on the number of threads.
+        std::tuple<float, float> greedy(const std::vector<uint32_t> &expected_size);
+        std::tuple<float, float> connected_components(const std::vector<uint32_t> &expected_size);
+};
+
+#endif /* threshold_sweep_hpp */
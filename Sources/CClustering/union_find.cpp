@@ -0,0 +1,68 @@
+//
+//  union_find.cpp
+//
+
+#include "union_find.hpp"
+#include <utility>
+
+
+uint32_t UnionFind::find(uint32_t item) {
+    while (this->parents[item] != item) {
+        this->parents[item] = this->parents[this->parents[item]];
+        item = this->parents[item];
+    }
+    
+    return item;
+}
+
+bool UnionFind::unite(const uint32_t item1, const uint32_t item2) {
+    uint32_t root1 = this->find(item1);
+    uint32_t root2 = this->find(item2);
+    
+    if (root1 == root2) {
+        return false;
+    }
+    
+    if (this->sizes[root1] < this->sizes[root2]) {
+        std::swap(root1, root2);
+    }
+    
+    this->parents[root2] = root1;
+    this->sizes[root1] += this->sizes[root2];
+    
+    return true;
+}
+
+void UnionFind::reset(const size_t items) {
+    this->parents.resize(items);
+    this->sizes.assign(items, 1);
+    
+    for (size_t i = 0;i < items;i++) {
+        this->parents[i] = i;
+    }
+}
+
+void UnionFind::isolate(const std::vector<uint32_t> &items) {
+    for (const uint32_t item : items) {
+        this->parents[item] = item;
+        this->sizes[item] = 1;
+    }
+}
+
+void UnionFind::insert(const size_t idx) {
+    for (uint32_t &parent : this->parents) {
+        parent += parent >= idx;
+    }
+    
+    this->parents.insert(this->parents.begin() + idx, idx);
+    this->sizes.insert(this->sizes.begin() + idx, 1);
+}
+
+void UnionFind::erase(const size_t idx) {
+    this->parents.erase(this->parents.begin() + idx);
+    this->sizes.erase(this->sizes.begin() + idx);
+    
+    for (uint32_t &parent : this->parents) {
+        parent -= parent > idx;
+    }
+}
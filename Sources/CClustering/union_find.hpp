@@ -0,0 +1,33 @@
+//
+//  union_find.hpp
+//
+
+#ifndef union_find_hpp
+#define union_find_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Disjoint sets over item positions, with union by size and path halving so that find and unite
+// are O(α(n)) amortized. Items can be inserted or erased at any position like in the similarity
+// matrix, which renumbers the parents in O(n).
+class UnionFind {
+    private:
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> sizes;
+    public:
+        size_t size() const { return this->parents.size(); }
+        uint32_t find(uint32_t item);
+        bool unite(const uint32_t item1, const uint32_t item2);
+        
+        void reset(const size_t items);
+        // Turn every item of a whole set into its own singleton.
+        void isolate(const std::vector<uint32_t> &items);
+        // Insert a singleton before idx.
+        void insert(const size_t idx);
+        // Erase the singleton at idx.
+        void erase(const size_t idx);
+};
+
+#endif /* union_find_hpp */
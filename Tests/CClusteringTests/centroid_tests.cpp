@@ -0,0 +1,84 @@
+//
+//  centroid_tests.cpp
+//
+
+#include "test_support.hpp"
+
+// Whether two items are in the same cluster, for every pair of the first items.
+static std::vector<bool> co_membership(const Clusters &clusters, const std::vector<bool> &kept) {
+    std::vector<uint32_t> labels = partition(clusters);
+    std::vector<uint32_t> kept_labels;
+    std::vector<bool> pairs;
+    
+    for (size_t i = 0;i < labels.size();i++) {
+        if (kept[i]) {
+            kept_labels.push_back(labels[i]);
+        }
+    }
+    
+    for (size_t i = 0;i < kept_labels.size();i++) {
+        for (size_t j = i + 1;j < kept_labels.size();j++) {
+            pairs.push_back(kept_labels[i] == kept_labels[j]);
+        }
+    }
+    
+    return pairs;
+}
+
+// An addition decided by the centroids returns every item once and leaves the other items in their
+// clusters. The next full clustering gives the pending items their similarities, and the clusters
+// of a brute force. The additions mostly come in runs, so that many items are pending at once.
+static void test_pending_items(const unsigned seed) {
+    RandomClustering random(seed, 0.4659, GREEDY_CLUSTERING, DENSE_SIMILARITIES);
+    uint64_t hits = 0;
+    
+    CHECK(random.clustering->set_centroid_fast_path(0.1) == 0);
+    CHECK(random.clustering->set_consistency_check(true) == 0);
+    
+    for (int step = 0;step < 200;step++) {
+        Clusters previous = random.clusters;
+        std::vector<bool> kept(random.items.size() + 1, true);
+        
+        if (step % 10 < 7) {
+            ClusteringResultV2 result;
+            int idx = random.generator() % (random.items.size() + 1);
+            int item = random.generator() % 8 == 0 ? -1 : int(random.generator() % random.store.size());
+            std::string text = item_text(item);
+            
+            CHECK(random.clustering->add_textual_item(text.c_str(), idx, &result) == 0);
+            random.clusters = take_clusters(result);
+            random.items.insert(random.items.begin() + idx, item);
+            kept[idx] = false;
+        } else {
+            random.step();
+            kept.clear();
+        }
+        
+        if (std::get<0>(random.clustering->get_centroid_fast_path_stats()) == hits) {
+            CHECK(random.clusters == brute_force_greedy(random.embeddings(), random.threshold));
+            continue;
+        }
+        
+        std::vector<uint32_t> sorted_indices = random.clusters.indices;
+        
+        std::sort(sorted_indices.begin(), sorted_indices.end());
+        hits++;
+        
+        CHECK(sorted_indices.size() == random.items.size());
+        CHECK(std::adjacent_find(sorted_indices.begin(), sorted_indices.end()) == sorted_indices.end());
+        
+        if (!kept.empty()) {
+            CHECK(co_membership(random.clusters, kept) == co_membership(previous, std::vector<bool>(random.items.size() - 1, true)));
+        }
+    }
+    
+    CHECK(hits > 0);
+}
+
+int main() {
+    for (unsigned seed = 0;seed < 10;seed++) {
+        test_pending_items(seed);
+    }
+    
+    return failures > 0 ? 1 : 0;
+}
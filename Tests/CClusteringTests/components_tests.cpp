@@ -0,0 +1,30 @@
+//
+//  components_tests.cpp
+//
+
+#include "test_support.hpp"
+
+// The union-find components maintained across random additions and removals, a removal rebuilding
+// the component of the item, give the connected components of a search and of a full recompute.
+static void test_incremental_components(const SimilarityStorage storage, const float threshold, const unsigned seed) {
+    RandomClustering random(seed, threshold, CONNECTED_COMPONENTS_CLUSTERING, storage);
+    
+    for (int step = 0;step < 150;step++) {
+        random.step();
+        CHECK(random.clusters == brute_force_components(random.embeddings(), threshold));
+    }
+    
+    CHECK(random.clusters == random.recompute());
+}
+
+int main() {
+    for (unsigned seed = 0;seed < 10;seed++) {
+        for (const float threshold : {0.4659f, 0.7f}) {
+            test_incremental_components(DENSE_SIMILARITIES, threshold, seed);
+            test_incremental_components(PACKED_SIMILARITIES, threshold, seed);
+            test_incremental_components(SPARSE_SIMILARITIES, threshold, seed);
+        }
+    }
+    
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+//
+//  dendrogram_tests.cpp
+//
+
+#include "test_support.hpp"
+
+// The clusters cut from the dendrogram, maintained across random additions and removals, are the
+// connected components at the threshold of the cut. It is built when the connected components
+// strategy, the only one allowing the cuts, is set after a few steps, and again when the storage
+// switches between sparse and not, and after a strategy change. The sparse storage refuses the cuts
+// under its floor.
+static void test_incremental_dendrogram(const SimilarityStorage storage, const unsigned seed) {
+    RandomClustering random(seed, 0.4659, GREEDY_CLUSTERING, storage);
+    std::vector<float> cut_thresholds = {-0.3, 0.1, 0.3, 0.4659, 0.6, 0.8};
+    SimilarityStorage current_storage = storage;
+    
+    for (int step = 0;step < 150;step++) {
+        random.step();
+        
+        if (step == 20) {
+            CHECK(random.clustering->set_clustering_strategy(CONNECTED_COMPONENTS_CLUSTERING) == 0);
+        }
+        
+        if (step == 50) {
+            current_storage = storage == SPARSE_SIMILARITIES ? DENSE_SIMILARITIES : SPARSE_SIMILARITIES;
+            CHECK(random.clustering->set_similarity_storage(current_storage) == 0);
+        }
+        
+        if (step == 100) {
+            ClusteringResultV2 greedy_result;
+            
+            CHECK(random.clustering->set_clustering_strategy(GREEDY_CLUSTERING) == 0);
+            CHECK(random.clustering->clusters_at_threshold(0.4659, &greedy_result) == -1);
+            CHECK(take_clusters(greedy_result) == Clusters());
+            CHECK(random.clustering->set_clustering_strategy(CONNECTED_COMPONENTS_CLUSTERING) == 0);
+        }
+        
+        ClusteringResultV2 result;
+        
+        if (step < 20) {
+            CHECK(random.clustering->clusters_at_threshold(0.4659, &result) == -1);
+            CHECK(take_clusters(result) == Clusters());
+            continue;
+        }
+        
+        if (step % 3 == 0) {
+            continue;
+        }
+        
+        float cut_threshold = cut_thresholds[random.generator() % cut_thresholds.size()];
+        
+        if (current_storage == SPARSE_SIMILARITIES && cut_threshold < 0.3) {
+            CHECK(random.clustering->clusters_at_threshold(cut_threshold, &result) == -1);
+            CHECK(take_clusters(result) == Clusters());
+            continue;
+        }
+        
+        CHECK(random.clustering->clusters_at_threshold(cut_threshold, &result) == 0);
+        CHECK(take_clusters(result) == brute_force_components(random.embeddings(), cut_threshold));
+        CHECK(random.clustering->get_threshold() == random.threshold);
+    }
+}
+
+int main() {
+    for (unsigned seed = 0;seed < 10;seed++) {
+        test_incremental_dendrogram(DENSE_SIMILARITIES, seed);
+        test_incremental_dendrogram(PACKED_SIMILARITIES, seed);
+        test_incremental_dendrogram(SPARSE_SIMILARITIES, seed);
+    }
+    
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+//
+//  greedy_tests.cpp
+//
+
+#include "test_support.hpp"
+
+// The greedy rows maintained across random additions and removals give the clusters of a brute
+// force and of a full recompute, with the consistency check agreeing, on every storage. At a
+// threshold of 0.25 many similarities are on it, and many candidates of a same size.
+static void test_incremental_rows(const float threshold, const SimilarityStorage storage, const unsigned seed) {
+    RandomClustering random(seed, threshold, GREEDY_CLUSTERING, storage);
+    
+    CHECK(random.clustering->set_consistency_check(true) == 0);
+    
+    for (int step = 0;step < 150;step++) {
+        random.step();
+        CHECK(random.clusters == brute_force_greedy(random.embeddings(), random.threshold));
+    }
+    
+    CHECK(random.clusters == random.recompute());
+}
+
+// The middle item is exactly on the threshold with the two others, so only its complete row holds
+// them all while their own rows hold themselves alone.
+static void test_complete_row(const SimilarityStorage storage) {
+    std::vector<std::vector<float>> store(3, std::vector<float>(hidden_size, 0));
+    const std::vector<std::vector<size_t>> entries = {{0, 1, 2, 3}, {3, 8, 12, 13}, {8, 9, 10, 11}};
+    std::unique_ptr<Clustering> clustering = make_clustering(store, 0.25);
+    ClusteringResultV2 result;
+    
+    for (size_t i = 0;i < store.size();i++) {
+        for (const size_t k : entries[i]) {
+            store[i][k] = 0.5;
+        }
+    }
+    
+    CHECK(clustering->set_similarity_storage(storage) == 0);
+    CHECK(clustering->set_consistency_check(true) == 0);
+    CHECK(clustering->add_textual_item("0", 0, &result) == 0);
+    take_clusters(result);
+    CHECK(clustering->add_textual_item("2", 1, &result) == 0);
+    take_clusters(result);
+    CHECK(clustering->add_textual_item("1", 1, &result) == 0);
+    CHECK(take_clusters(result) == Clusters({{0, 1, 2}, {3}}));
+    CHECK(clustering->remove_textual_item(1, 0, &result) == 0);
+    CHECK(take_clusters(result) == Clusters({{0, 1}, {1, 1}}));
+}
+
+int main() {
+    for (unsigned seed = 0;seed < 10;seed++) {
+        for (const float threshold : {0.25f, 0.4659f}) {
+            test_incremental_rows(threshold, DENSE_SIMILARITIES, seed);
+            test_incremental_rows(threshold, PACKED_SIMILARITIES, seed);
+            test_incremental_rows(threshold, SPARSE_SIMILARITIES, seed);
+        }
+    }
+    
+    test_complete_row(DENSE_SIMILARITIES);
+    test_complete_row(PACKED_SIMILARITIES);
+    test_complete_row(SPARSE_SIMILARITIES);
+    
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+//
+//  hnsw_tests.cpp
+//
+
+#include "test_support.hpp"
+#include "hnsw_index.hpp"
+#include <cmath>
+
+static const size_t dimension = 32;
+
+// Unit vector drawn around one of the prototypes, close enough for most similarities within a
+// cluster to be above the floor.
+static std::vector<float> clustered_vector(std::mt19937 &generator, const std::vector<std::vector<float>> &prototypes) {
+    std::normal_distribution<float> distribution(0, 0.12);
+    std::vector<float> vector = prototypes[generator() % prototypes.size()];
+    float norm = 0;
+    
+    for (float &value : vector) {
+        value += distribution(generator);
+        norm += value * value;
+    }
+    
+    for (float &value : vector) {
+        value /= std::sqrt(norm);
+    }
+    
+    return vector;
+}
+
+// Searches after interleaved insertions and erasures at random positions, down to far fewer live
+// items than erased ones so that the graph is rebuilt, return only live items at their current
+// position with their exact similarity, and most of the items an exact scan finds.
+static void test_search(const unsigned seed) {
+    const float floor = 0.3;
+    std::mt19937 generator(seed);
+    std::normal_distribution<float> distribution;
+    std::vector<std::vector<float>> prototypes(6, std::vector<float>(dimension));
+    std::vector<std::vector<float>> items;
+    HnswIndex index(dimension, 8, 64, 16);
+    size_t expected_count = 0;
+    size_t found_count = 0;
+    
+    for (std::vector<float> &prototype : prototypes) {
+        float norm = 0;
+        
+        for (float &value : prototype) {
+            value = distribution(generator);
+            norm += value * value;
+        }
+        
+        for (float &value : prototype) {
+            value /= std::sqrt(norm);
+        }
+    }
+    
+    for (int step = 0;step < 900;step++) {
+        // Grow to 300 items, shrink to 40, then grow again.
+        bool erase = !items.empty() && (step >= 300 && step < 600 ? generator() % 10 < 9 : generator() % 10 < 3);
+        
+        if (erase) {
+            size_t position = generator() % items.size();
+            
+            index.erase(position);
+            items.erase(items.begin() + position);
+        } else {
+            size_t position = generator() % (items.size() + 1);
+            std::vector<float> vector = clustered_vector(generator, prototypes);
+            
+            index.insert(position, vector.data());
+            items.insert(items.begin() + position, vector);
+        }
+        
+        CHECK(index.size() == items.size());
+        
+        if (step % 10 != 0) {
+            continue;
+        }
+        
+        for (int query_count = 0;query_count < 8;query_count++) {
+            std::vector<float> query = query_count % 2 == 0 && !items.empty() ? items[generator() % items.size()] : clustered_vector(generator, prototypes);
+            std::vector<SimilarityEdge> neighbors = index.search(query.data(), floor);
+            
+            for (size_t k = 0;k < neighbors.size();k++) {
+                CHECK(neighbors[k].item < items.size());
+                CHECK(k == 0 || neighbors[k - 1].item < neighbors[k].item);
+                
+                if (neighbors[k].item < items.size()) {
+                    CHECK(std::fabs(neighbors[k].similarity - kernels::dot_product_scalar(query.data(), items[neighbors[k].item].data(), dimension)) < 1e-5);
+                    CHECK(neighbors[k].similarity >= floor);
+                }
+            }
+            
+            for (size_t i = 0;i < items.size();i++) {
+                if (kernels::dot_product_scalar(query.data(), items[i].data(), dimension) >= floor + 1e-5) {
+                    expected_count++;
+                    found_count += std::any_of(neighbors.begin(), neighbors.end(), [i](const SimilarityEdge &edge){ return edge.item == i; });
+                }
+            }
+        }
+    }
+    
+    CHECK(expected_count > 5000);
+    CHECK(found_count >= 0.95 * expected_count);
+}
+
+int main() {
+    for (unsigned seed = 0;seed < 5;seed++) {
+        test_search(seed);
+    }
+    
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+//
+//  inference_tests.cpp
+//
+
+#include "test_support.hpp"
+
+// The tensors over the workspace are only created again when the shape of the batch changes, the
+// output kind changes or a buffer grows, every one of them counted.
+static void test_workspace_binding() {
+    InferenceWorkspace workspace(hidden_size, 1);
+    std::vector<std::vector<int32_t>> batch = {{5, 6, 7}, {8}};
+    std::vector<std::vector<int32_t>> shorter = {{5, 6}, {8}};
+    std::vector<float> embeddings(2 * hidden_size);
+    
+    CHECK(workspace.prepare(batch.data(), 2, false, 3));
+    CHECK(workspace.get_allocations() == 4 + 3);
+    CHECK(!workspace.prepare(batch.data(), 2, false, 3));
+    CHECK(workspace.prepare(shorter.data(), 2, false, 3));
+    CHECK(workspace.prepare(batch.data(), 2, false, 3));
+    CHECK(workspace.get_allocations() == 4 + 3 * 3);
+    
+    CHECK(workspace.input(INPUT_IDS) == std::vector<int32_t>({5, 6, 7, 8, 1, 1}));
+    CHECK(workspace.input(ATTENTION_MASK) == std::vector<int32_t>({1, 1, 1, 1, 0, 0}));
+    
+    workspace.unbind();
+    
+    CHECK(workspace.prepare(batch.data(), 2, false, 3));
+    
+    // The token states are [batch, seq, hidden_size], the embedding of a sequence its first token.
+    CHECK(workspace.prepare(batch.data(), 2, true, 3));
+    CHECK(workspace.output_rank() == 3 && workspace.output_size() == 2 * 3 * hidden_size);
+    
+    for (size_t k = 0;k < workspace.output_size();k++) {
+        workspace.output()[k] = k;
+    }
+    
+    workspace.extract(embeddings.data());
+    
+    CHECK(embeddings[0] == 0 && embeddings[hidden_size - 1] == hidden_size - 1);
+    CHECK(embeddings[hidden_size] == 3 * hidden_size);
+}
+
+// Once the workspace fits, additions of a same shape allocate nothing in the inference, whatever
+// the destination of their embedding.
+static void test_steady_additions() {
+    std::mt19937 generator(0);
+    std::vector<std::vector<float>> store = clustered_embeddings(generator, 200, 5);
+    std::unique_ptr<Clustering> clustering = make_clustering(store, 0.4659);
+    std::vector<std::string> texts = {"1", "2", "3"};
+    std::vector<const char*> text_pointers = {texts[0].c_str(), texts[1].c_str(), texts[2].c_str()};
+    std::vector<int> idxs = {0, 1, 2};
+    ClusteringResultV2 result;
+    
+    for (int i = 0;i < 5;i++) {
+        clustering->add_textual_item(item_text(i).c_str(), 0, &result);
+        take_clusters(result);
+    }
+    
+    uint64_t allocations = clustering->get_inference_stats().allocations;
+    
+    for (int i = 0;i < 100;i++) {
+        clustering->add_textual_item(item_text(generator() % store.size()).c_str(), generator() % (5 + i + 1), &result);
+        take_clusters(result);
+    }
+    
+    CHECK(clustering->get_inference_stats().allocations == allocations);
+    
+    // A batch changes the shape of the tensors, the next single addition creates them again.
+    clustering->add_textual_items(text_pointers.data(), idxs.data(), 3, &result);
+    take_clusters(result);
+    clustering->add_textual_item("4", 0, &result);
+    take_clusters(result);
+    
+    CHECK(clustering->get_inference_stats().allocations > allocations);
+    
+    allocations = clustering->get_inference_stats().allocations;
+    
+    for (int i = 0;i < 100;i++) {
+        clustering->add_textual_item(item_text(generator() % store.size()).c_str(), 0, &result);
+        take_clusters(result);
+    }
+    
+    CHECK(clustering->get_inference_stats().allocations == allocations);
+    CHECK(clustering->get_inference_stats().sequences == 5 + 100 + 3 + 1 + 100);
+}
+
+// Sequences of mixed lengths go to the bucket of their length, the longest ones to the last bucket,
+// which runs before one more sequence exceeds the token budget. Every batch only holds sequences of
+// its bucket, every embedding reaches the row of its sequence, and the padding is the one to the
+// longest sequence of every batch.
+static void test_bucket_routing() {
+    std::vector<std::vector<int32_t>> batches;
+    InferenceScheduler scheduler(hidden_size, [&batches](const std::vector<int32_t>* input_ids, const size_t batch_size, float* embeddings){
+        std::vector<int32_t> lengths;
+        
+        for (size_t b = 0;b < batch_size;b++) {
+            lengths.push_back(input_ids[b].size());
+            std::fill(embeddings + b * hidden_size, embeddings + (b + 1) * hidden_size, float(input_ids[b].front()));
+        }
+        
+        batches.push_back(lengths);
+        
+        return 1.0f;
+    });
+    std::vector<size_t> lengths = {2, 7, 3, 12, 5, 4};
+    std::vector<std::vector<float>> embeddings(lengths.size(), std::vector<float>(hidden_size, -1));
+    
+    CHECK(scheduler.configure({4, 8}, 16) == 0);
+    CHECK(scheduler.configure({8, 4}, 16) == -1);
+    CHECK(scheduler.configure({4, 8}, 0) == -1);
+    
+    for (size_t i = 0;i < lengths.size();i++) {
+        scheduler.submit(std::vector<int32_t>(lengths[i], int32_t(100 + i)), embeddings[i].data());
+    }
+    
+    // 7 ran alone before 12 exceeded the budget with it, and 12 before 5.
+    CHECK(batches == std::vector<std::vector<int32_t>>({{7}, {12}}));
+    CHECK(scheduler.flush() == 4);
+    CHECK(batches == std::vector<std::vector<int32_t>>({{7}, {12}, {2, 3, 4}, {5}}));
+    
+    for (size_t i = 0;i < lengths.size();i++) {
+        CHECK(embeddings[i] == std::vector<float>(hidden_size, 100 + i));
+    }
+    
+    InferenceStats stats = scheduler.get_stats();
+    
+    CHECK(stats.batches == 4 && stats.sequences == 6);
+    CHECK(stats.tokens == 33 && stats.padding_tokens == 3);
+    CHECK(stats.inference_time == 4);
+    CHECK(scheduler.flush() == 0);
+}
+
+int main() {
+    test_workspace_binding();
+    test_bucket_routing();
+    test_steady_additions();
+    
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,248 @@
+//
+//  kernels_tests.cpp
+//
+
+#include "test_support.hpp"
+#include "kernels.hpp"
+#include "similarity_matrix.hpp"
+#include <cmath>
+
+// Every dot product variant the CPU supports agrees with the scalar reference, within the rounding
+// of a float accumulation, over every length up to a few vector widths and unaligned starts.
+static void test_dot_product_variants() {
+    const char* instruction_sets[] = {"scalar", "sse4", "avx2", "avx512", "neon"};
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    std::vector<float> vector1(300);
+    std::vector<float> vector2(300);
+    
+    for (size_t k = 0;k < vector1.size();k++) {
+        vector1[k] = distribution(generator);
+        vector2[k] = distribution(generator);
+    }
+    
+    CHECK(kernels::dot_product_variant(kernels::instruction_set()) == kernels::dot_product_function());
+    
+    for (const char* instruction_set : instruction_sets) {
+        kernels::DotProductFunction dot_product = kernels::dot_product_variant(instruction_set);
+        
+        if (dot_product == nullptr) {
+            continue;
+        }
+        
+        for (size_t offset = 0;offset < 4;offset++) {
+            for (size_t size = 0;size + offset <= vector1.size() && size <= 140;size++) {
+                double magnitude = 0;
+                
+                for (size_t k = 0;k < size;k++) {
+                    magnitude += std::fabs(vector1[offset + k] * vector2[offset + k]);
+                }
+                
+                float expected = kernels::dot_product_scalar(vector1.data() + offset, vector2.data() + offset, size);
+                float value = dot_product(vector1.data() + offset, vector2.data() + offset, size);
+                
+                CHECK(std::fabs(value - expected) <= 1e-5 * (magnitude + 1));
+            }
+        }
+    }
+}
+
+// The blocked Gram matrix of the dispatched and the scalar micro-kernels agrees with the per pair
+// dot products, for row counts and depths that leave partial micro-tiles and blocks.
+static void test_gram_matrix() {
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    
+    for (const size_t rows : {1, 2, 3, 5, 7, 63, 65, 66, 130}) {
+        for (const size_t size : {16, 272, 528}) {
+            size_t stride = size + kernels::gram_padding;
+            size_t result_stride = rows + 3;
+            std::vector<float> matrix(rows * stride);
+            std::vector<float> result(rows * result_stride);
+            std::vector<float> scalar_result(rows * result_stride);
+            
+            for (size_t i = 0;i < rows;i++) {
+                for (size_t k = 0;k < size;k++) {
+                    matrix[i * stride + k] = distribution(generator);
+                }
+            }
+            
+            kernels::gram_matrix(matrix.data(), rows, size, stride, result.data(), result_stride);
+            kernels::gram_matrix_scalar(matrix.data(), rows, size, stride, scalar_result.data(), result_stride);
+            
+            for (size_t i = 0;i < rows;i++) {
+                for (size_t j = 0;j < rows;j++) {
+                    double expected = 0;
+                    double magnitude = 0;
+                    
+                    for (size_t k = 0;k < size;k++) {
+                        expected += double(matrix[i * stride + k]) * matrix[j * stride + k];
+                        magnitude += std::fabs(matrix[i * stride + k] * matrix[j * stride + k]);
+                    }
+                    
+                    CHECK(std::fabs(result[i * result_stride + j] - expected) <= 1e-5 * (magnitude + 1));
+                    CHECK(std::fabs(scalar_result[i * result_stride + j] - expected) <= 1e-5 * (magnitude + 1));
+                }
+            }
+        }
+    }
+}
+
+// The rectangular product agrees with the per pair dot products, for shapes leaving partial
+// micro-tiles and blocks on both sides.
+static void test_cross_gram_matrix() {
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    
+    for (const size_t rows1 : {1, 3, 5, 66}) {
+        for (const size_t rows2 : {1, 7, 65, 130}) {
+            for (const size_t size : {16, 272}) {
+                size_t stride = size + kernels::gram_padding;
+                size_t result_stride = rows2 + 3;
+                std::vector<float> matrix1(rows1 * stride);
+                std::vector<float> matrix2(rows2 * stride);
+                std::vector<float> result(rows1 * result_stride);
+                
+                for (float &value : matrix1) {
+                    value = distribution(generator);
+                }
+                
+                for (float &value : matrix2) {
+                    value = distribution(generator);
+                }
+                
+                kernels::cross_gram_matrix(matrix1.data(), rows1, matrix2.data(), rows2, size, stride, result.data(), result_stride);
+                
+                for (size_t i = 0;i < rows1;i++) {
+                    for (size_t j = 0;j < rows2;j++) {
+                        double expected = 0;
+                        double magnitude = 0;
+                        
+                        for (size_t k = 0;k < size;k++) {
+                            expected += double(matrix1[i * stride + k]) * matrix2[j * stride + k];
+                            magnitude += std::fabs(matrix1[i * stride + k] * matrix2[j * stride + k]);
+                        }
+                        
+                        CHECK(std::fabs(result[i * result_stride + j] - expected) <= 1e-5 * (magnitude + 1));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The similarities computed at once in both storages are the per pair dot products of the rows,
+// whose padding to the matrix stride the kernels run over.
+static void test_similarity_compute() {
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    
+    for (const size_t rows : {1, 5, 66, 130}) {
+        for (const size_t size : {20, 300}) {
+            Matrix embeddings(size);
+            
+            embeddings.reset(rows, size);
+            
+            for (size_t i = 0;i < rows;i++) {
+                for (size_t k = 0;k < size;k++) {
+                    embeddings[i][k] = distribution(generator);
+                }
+            }
+            
+            for (const SimilarityStorage storage : {DENSE_SIMILARITIES, PACKED_SIMILARITIES}) {
+                SimilarityMatrix similarities(storage);
+                
+                similarities.compute(embeddings);
+                CHECK(similarities.size() == rows);
+                
+                for (size_t i = 0;i < rows;i++) {
+                    for (size_t j = 0;j < rows;j++) {
+                        double expected = 0;
+                        double magnitude = 0;
+                        
+                        for (size_t k = 0;k < size;k++) {
+                            expected += double(embeddings[i][k]) * embeddings[j][k];
+                            magnitude += std::fabs(embeddings[i][k] * embeddings[j][k]);
+                        }
+                        
+                        CHECK(std::fabs(similarities.get(i, j) - expected) <= 1e-5 * (magnitude + 1));
+                        CHECK(similarities[i][j] == similarities.get(i, j));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Items inserted at once at random positions move every similarity to the positions of its items,
+// and start without any similarity, in every storage.
+static void test_similarity_insert() {
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> distribution(-1, 1);
+    
+    for (const size_t rows : {0, 1, 9, 40}) {
+        for (const size_t inserted : {1, 3, 50}) {
+            Matrix embeddings(20);
+            std::vector<size_t> positions;
+            
+            embeddings.reset(rows, 20);
+            
+            for (size_t i = 0;i < rows;i++) {
+                for (size_t k = 0;k < 20;k++) {
+                    embeddings[i][k] = distribution(generator);
+                }
+            }
+            
+            for (size_t i = 0;i < rows + inserted;i++) {
+                if (positions.size() < inserted && generator() % (rows + inserted - i) < inserted - positions.size()) {
+                    positions.push_back(i);
+                }
+            }
+            
+            for (const SimilarityStorage storage : {DENSE_SIMILARITIES, PACKED_SIMILARITIES, SPARSE_SIMILARITIES}) {
+                SimilarityMatrix similarities(storage);
+                std::vector<size_t> old_items;
+                
+                similarities.compute(embeddings);
+                
+                SimilarityMatrix previous = similarities;
+                
+                similarities.insert(positions);
+                CHECK(similarities.size() == rows + inserted);
+                
+                for (size_t i = 0;i < rows + inserted;i++) {
+                    if (!std::binary_search(positions.begin(), positions.end(), i)) {
+                        CHECK(inserted_position(positions, old_items.size()) == i);
+                        old_items.push_back(i);
+                    }
+                }
+                
+                for (size_t i = 0;i < rows + inserted;i++) {
+                    for (size_t j = 0;j < rows + inserted;j++) {
+                        bool new_pair = std::binary_search(positions.begin(), positions.end(), i) || std::binary_search(positions.begin(), positions.end(), j);
+                        float missing = storage == SPARSE_SIMILARITIES ? SimilarityRow::missing_similarity : 0;
+                        
+                        if (new_pair) {
+                            CHECK(similarities.get(i, j) == missing);
+                        } else {
+                            size_t old_i = std::lower_bound(old_items.begin(), old_items.end(), i) - old_items.begin();
+                            size_t old_j = std::lower_bound(old_items.begin(), old_items.end(), j) - old_items.begin();
+                            
+                            CHECK(similarities.get(i, j) == previous.get(old_i, old_j));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    test_dot_product_variants();
+    test_gram_matrix();
+    test_cross_gram_matrix();
+    test_similarity_compute();
+    test_similarity_insert();
+    
+    return failures > 0 ? 1 : 0;
+}
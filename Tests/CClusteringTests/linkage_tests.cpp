@@ -0,0 +1,126 @@
+//
+//  linkage_tests.cpp
+//
+
+#include "test_support.hpp"
+
+// Agglomerative clustering merging the two clusters of highest linkage while it is at or above
+// the threshold, recomputing every linkage from the item similarities, in O(n³) per merge.
+static Clusters brute_force_linkage(const std::vector<std::vector<float>> &embeddings, const Linkage linkage, const float threshold) {
+    std::vector<std::vector<double>> normalized;
+    std::vector<std::vector<uint32_t>> clusters;
+    std::vector<uint32_t> null_items;
+    
+    for (size_t i = 0;i < embeddings.size();i++) {
+        double norm = std::sqrt(std::inner_product(embeddings[i].begin(), embeddings[i].end(), embeddings[i].begin(), 0.0));
+        
+        normalized.push_back(std::vector<double>(embeddings[i].begin(), embeddings[i].end()));
+        
+        if (norm == 0) {
+            null_items.push_back(i);
+            continue;
+        }
+        
+        for (double &value : normalized.back()) {
+            value /= norm;
+        }
+        
+        clusters.push_back(std::vector<uint32_t>(1, i));
+    }
+    
+    while (clusters.size() > 1) {
+        double best = -std::numeric_limits<double>::infinity();
+        size_t best1 = 0;
+        size_t best2 = 0;
+        
+        for (size_t c1 = 0;c1 < clusters.size();c1++) {
+            for (size_t c2 = c1 + 1;c2 < clusters.size();c2++) {
+                double value = linkage == AVERAGE_LINKAGE ? 0 : std::numeric_limits<double>::infinity();
+                
+                for (const uint32_t i : clusters[c1]) {
+                    for (const uint32_t j : clusters[c2]) {
+                        double pair = std::inner_product(normalized[i].begin(), normalized[i].end(), normalized[j].begin(), 0.0);
+                        
+                        value = linkage == AVERAGE_LINKAGE ? value + pair : std::min(value, pair);
+                    }
+                }
+                
+                if (linkage == AVERAGE_LINKAGE) {
+                    value /= clusters[c1].size() * clusters[c2].size();
+                }
+                
+                if (value > best) {
+                    best = value;
+                    best1 = c1;
+                    best2 = c2;
+                }
+            }
+        }
+        
+        if (best < threshold) {
+            break;
+        }
+        
+        clusters[best1].insert(clusters[best1].end(), clusters[best2].begin(), clusters[best2].end());
+        clusters.erase(clusters.begin() + best2);
+    }
+    
+    for (std::vector<uint32_t> &cluster : clusters) {
+        std::sort(cluster.begin(), cluster.end());
+    }
+    
+    std::sort(clusters.begin(), clusters.end());
+    
+    if (!null_items.empty()) {
+        clusters.push_back(null_items);
+    }
+    
+    return sorted_candidates(clusters);
+}
+
+// The average and complete linkages after random additions and removals give the clusters of a
+// brute force on the dense and packed storages, which they leave unchanged.
+static void test_linkage(const ClusteringStrategy strategy, const SimilarityStorage storage, const unsigned seed) {
+    RandomClustering random(seed, 0.4659, strategy, storage, gaussian_embeddings);
+    Linkage linkage = strategy == AVERAGE_LINKAGE_CLUSTERING ? AVERAGE_LINKAGE : COMPLETE_LINKAGE;
+    
+    for (int step = 0;step < 100;step++) {
+        random.step();
+        CHECK(random.clusters == brute_force_linkage(random.embeddings(), linkage, random.threshold));
+        
+        // The similarities overwritten by the merges are restored for the other strategies.
+        if (step % 25 == 24) {
+            CHECK(random.clustering->set_clustering_strategy(CONNECTED_COMPONENTS_CLUSTERING) == 0);
+            random.step();
+            CHECK(random.clusters == brute_force_components(random.embeddings(), random.threshold));
+            CHECK(random.clustering->set_clustering_strategy(strategy) == 0);
+        }
+    }
+}
+
+// The sparse storage misses similarities that weigh in the average linkage, the linkage strategies
+// and the sparse storage reject each other.
+static void test_sparse_rejected(const ClusteringStrategy strategy) {
+    RandomClustering random(0, 0.4659, strategy, DENSE_SIMILARITIES, gaussian_embeddings);
+    
+    CHECK(random.clustering->set_similarity_storage(SPARSE_SIMILARITIES) == -1);
+    CHECK(random.clustering->set_clustering_strategy(GREEDY_CLUSTERING) == 0);
+    CHECK(random.clustering->set_similarity_storage(SPARSE_SIMILARITIES) == 0);
+    CHECK(random.clustering->set_clustering_strategy(strategy) == -1);
+    CHECK(random.clustering->set_similarity_storage(PACKED_SIMILARITIES) == 0);
+    CHECK(random.clustering->set_clustering_strategy(strategy) == 0);
+}
+
+int main() {
+    for (unsigned seed = 0;seed < 10;seed++) {
+        for (const ClusteringStrategy strategy : {AVERAGE_LINKAGE_CLUSTERING, COMPLETE_LINKAGE_CLUSTERING}) {
+            test_linkage(strategy, DENSE_SIMILARITIES, seed);
+            test_linkage(strategy, PACKED_SIMILARITIES, seed);
+        }
+    }
+    
+    test_sparse_rejected(AVERAGE_LINKAGE_CLUSTERING);
+    test_sparse_rejected(COMPLETE_LINKAGE_CLUSTERING);
+    
+    return failures > 0 ? 1 : 0;
+}
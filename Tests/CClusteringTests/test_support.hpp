@@ -0,0 +1,446 @@
+//
+//  test_support.hpp
+//
+
+#ifndef test_support_hpp
+#define test_support_hpp
+
+#include "clustering.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// A failed check is reported and makes the test fail, the following ones still run.
+static int failures = 0;
+
+#define CHECK(condition) do { if (!(condition)) { std::cerr << __FILE__ << ":" << __LINE__ << ": " << #condition << std::endl; failures++; } } while (0)
+
+static const uint16_t hidden_size = 16;
+
+// The text of an item is the position of its embedding in a store shared with the test, the
+// inference copies it through a workspace like the model does.
+class FakeEncoder : public TextEncoder {
+    private:
+        const std::vector<std::vector<float>> &store;
+        InferenceWorkspace workspace;
+    public:
+        FakeEncoder(const std::vector<std::vector<float>> &store) : store(store), workspace(hidden_size, 1) {}
+        
+        uint16_t get_hidden_size() const override { return hidden_size; }
+        
+        std::tuple<std::vector<int32_t>, float> tokenize(const std::string &text) override {
+            return std::tuple<std::vector<int32_t>, float>(std::vector<int32_t>(1, std::stoi(text)), 0);
+        }
+        
+        float predict_batch(const std::vector<int32_t>* input_ids, const size_t batch_size, float* embeddings) override {
+            this->workspace.prepare(input_ids, batch_size, false, 2);
+            
+            for (size_t b = 0;b < batch_size;b++) {
+                const std::vector<float> &embedding = this->store[input_ids[b].front()];
+                
+                std::copy(embedding.begin(), embedding.end(), this->workspace.output() + b * hidden_size);
+            }
+            
+            this->workspace.extract(embeddings);
+            
+            return 0;
+        }
+        
+        int set_output(const std::string &name) override {
+            this->workspace.unbind();
+            
+            return 0;
+        }
+        
+        uint64_t get_allocations() const override { return this->workspace.get_allocations(); }
+};
+
+inline std::unique_ptr<Clustering> make_clustering(const std::vector<std::vector<float>> &store, const float threshold) {
+    return std::unique_ptr<Clustering>(new Clustering(threshold, std::unique_ptr<TextEncoder>(new FakeEncoder(store))));
+}
+
+// Unit embeddings with four entries of ±0.5, so that every similarity is a multiple of 0.25 that
+// any kernel computes exactly, away from the thresholds of the tests. They are drawn around a few
+// prototypes, one or two of their entries moved, so that the clusters overlap.
+inline std::vector<std::vector<float>> clustered_embeddings(std::mt19937 &generator, const size_t count, const size_t prototypes) {
+    std::vector<std::vector<float>> embeddings;
+    
+    for (size_t i = 0;i < count;i++) {
+        std::vector<float> embedding(hidden_size, 0);
+        std::vector<size_t> entries;
+        
+        if (i < prototypes) {
+            while (entries.size() < 4) {
+                size_t entry = generator() % hidden_size;
+                
+                if (embedding[entry] == 0) {
+                    embedding[entry] = generator() % 2 ? 0.5 : -0.5;
+                    entries.push_back(entry);
+                }
+            }
+        } else {
+            embedding = embeddings[generator() % prototypes];
+            
+            for (size_t moves = generator() % 3;moves > 0;moves--) {
+                size_t from = generator() % hidden_size;
+                size_t to = generator() % hidden_size;
+                
+                if (embedding[from] != 0 && embedding[to] == 0) {
+                    embedding[to] = generator() % 2 ? 0.5 : -0.5;
+                    embedding[from] = 0;
+                }
+            }
+        }
+        
+        embeddings.push_back(embedding);
+    }
+    
+    return embeddings;
+}
+
+struct Clusters {
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> sizes;
+    
+    bool operator==(const Clusters &other) const { return this->indices == other.indices && this->sizes == other.sizes; }
+    bool operator!=(const Clusters &other) const { return !(*this == other); }
+};
+
+// Clusters of a result, which is freed.
+inline Clusters take_clusters(ClusteringResultV2 &result) {
+    Clusters clusters;
+    
+    clusters.indices.assign(result.cluster->indices, result.cluster->indices + result.cluster->indices_size);
+    clusters.sizes.assign(result.cluster->clusters_split, result.cluster->clusters_split + result.cluster->clusters_split_size);
+    delete[] result.cluster->indices;
+    delete[] result.cluster->clusters_split;
+    delete result.cluster;
+    
+    return clusters;
+}
+
+// Cluster of every item designated by its smallest item, to compare clusters in any order.
+inline std::vector<uint32_t> partition(const Clusters &clusters) {
+    std::vector<uint32_t> labels(clusters.indices.size());
+    size_t start = 0;
+    
+    for (const uint32_t size : clusters.sizes) {
+        uint32_t label = *std::min_element(clusters.indices.begin() + start, clusters.indices.begin() + start + size);
+        
+        for (size_t k = start;k < start + size;k++) {
+            labels[clusters.indices[k]] = label;
+        }
+        
+        start += size;
+    }
+    
+    return labels;
+}
+
+// Items of a clustering by position, as the index of their embedding in the store or -1 for an
+// empty text.
+inline std::string item_text(const int item) {
+    return item < 0 ? std::string() : std::to_string(item);
+}
+
+inline std::vector<std::vector<float>> item_embeddings(const std::vector<std::vector<float>> &store, const std::vector<int> &items) {
+    std::vector<std::vector<float>> embeddings;
+    
+    for (const int item : items) {
+        embeddings.push_back(item < 0 ? std::vector<float>(hidden_size, 0) : store[item]);
+    }
+    
+    return embeddings;
+}
+
+inline float similarity(const std::vector<float> &embedding1, const std::vector<float> &embedding2) {
+    return std::inner_product(embedding1.begin(), embedding1.end(), embedding2.begin(), 0.0f);
+}
+
+inline bool is_null(const std::vector<float> &embedding) {
+    return std::all_of(embedding.begin(), embedding.end(), [](float value){return value == 0;});
+}
+
+// Embeddings drawn around a few gaussian prototypes with as much noise, so that many similarities
+// within the clusters are under the sparse floor. Unlike the quantized ones their similarities
+// are never tied. They are normalized so that the brute forces can take their dot products.
+inline std::vector<std::vector<float>> gaussian_embeddings(std::mt19937 &generator, const size_t count, const size_t prototypes) {
+    std::normal_distribution<float> distribution;
+    std::vector<std::vector<float>> embeddings;
+    
+    for (size_t i = 0;i < count;i++) {
+        std::vector<float> embedding(hidden_size);
+        
+        for (size_t k = 0;k < hidden_size;k++) {
+            embedding[k] = distribution(generator);
+        }
+        
+        if (i >= prototypes) {
+            const std::vector<float> &prototype = embeddings[generator() % prototypes];
+            
+            std::transform(embedding.begin(), embedding.end(), prototype.begin(), embedding.begin(), std::plus<float>());
+        }
+        
+        float norm = std::sqrt(similarity(embedding, embedding));
+        
+        for (float &value : embedding) {
+            value /= norm;
+        }
+        
+        embeddings.push_back(embedding);
+    }
+    
+    return embeddings;
+}
+
+// The greedy clusters as documented: one candidate per item with a similarity at or above the
+// threshold, holding the items strictly above it or every item when they all are at or above it,
+// the null items in a last candidate. The candidates are sorted by decreasing size, stably, and
+// every item goes to the first one holding it.
+inline Clusters brute_force_greedy(const std::vector<std::vector<float>> &embeddings, const float threshold) {
+    std::vector<std::vector<uint32_t>> candidates;
+    std::vector<uint32_t> null_items;
+    
+    for (size_t i = 0;i < embeddings.size();i++) {
+        if (is_null(embeddings[i])) {
+            null_items.push_back(i);
+            continue;
+        }
+        
+        std::vector<uint32_t> members;
+        size_t above = 0;
+        
+        for (size_t j = 0;j < embeddings.size();j++) {
+            float value = is_null(embeddings[j]) ? 0 : similarity(embeddings[i], embeddings[j]);
+            
+            above += value >= threshold;
+            
+            if (value > threshold) {
+                members.push_back(j);
+            }
+        }
+        
+        if (above == embeddings.size()) {
+            members.resize(above);
+            std::iota(members.begin(), members.end(), 0);
+        }
+        
+        if (above > 0) {
+            candidates.push_back(members);
+        }
+    }
+    
+    if (!null_items.empty()) {
+        candidates.push_back(null_items);
+    }
+    
+    std::stable_sort(candidates.begin(), candidates.end(), [](const std::vector<uint32_t> &candidate1, const std::vector<uint32_t> &candidate2){ return candidate1.size() > candidate2.size(); });
+    
+    Clusters clusters;
+    std::vector<bool> extracted(embeddings.size(), false);
+    
+    for (const std::vector<uint32_t> &candidate : candidates) {
+        size_t start = clusters.indices.size();
+        
+        for (const uint32_t item : candidate) {
+            if (!extracted[item]) {
+                clusters.indices.push_back(item);
+                extracted[item] = true;
+            }
+        }
+        
+        if (clusters.indices.size() > start) {
+            clusters.sizes.push_back(clusters.indices.size() - start);
+        }
+    }
+    
+    return clusters;
+}
+
+// Clusters in the order of the results from a partition of the items into candidates listed by
+// increasing smallest member, the null items last.
+inline Clusters sorted_candidates(const std::vector<std::vector<uint32_t>> &candidates) {
+    std::vector<std::vector<uint32_t>> sorted = candidates;
+    Clusters clusters;
+    
+    std::stable_sort(sorted.begin(), sorted.end(), [](const std::vector<uint32_t> &candidate1, const std::vector<uint32_t> &candidate2){ return candidate1.size() > candidate2.size(); });
+    
+    for (const std::vector<uint32_t> &candidate : sorted) {
+        clusters.indices.insert(clusters.indices.end(), candidate.begin(), candidate.end());
+        clusters.sizes.push_back(candidate.size());
+    }
+    
+    return clusters;
+}
+
+// Connected components of the non null items linked at or above the threshold, found by a search
+// from every item.
+inline Clusters brute_force_components(const std::vector<std::vector<float>> &embeddings, const float threshold) {
+    std::vector<int> component(embeddings.size(), -1);
+    std::vector<std::vector<uint32_t>> candidates;
+    std::vector<uint32_t> null_items;
+    
+    for (size_t i = 0;i < embeddings.size();i++) {
+        if (is_null(embeddings[i])) {
+            null_items.push_back(i);
+            continue;
+        }
+        
+        if (component[i] >= 0) {
+            continue;
+        }
+        
+        std::vector<uint32_t> stack(1, i);
+        std::vector<uint32_t> members;
+        
+        component[i] = candidates.size();
+        
+        while (!stack.empty()) {
+            uint32_t item = stack.back();
+            
+            stack.pop_back();
+            members.push_back(item);
+            
+            for (size_t j = 0;j < embeddings.size();j++) {
+                if (component[j] < 0 && !is_null(embeddings[j]) && similarity(embeddings[item], embeddings[j]) >= threshold) {
+                    component[j] = candidates.size();
+                    stack.push_back(j);
+                }
+            }
+        }
+        
+        std::sort(members.begin(), members.end());
+        candidates.push_back(members);
+    }
+    
+    if (!null_items.empty()) {
+        candidates.push_back(null_items);
+    }
+    
+    return sorted_candidates(candidates);
+}
+
+// Apply a random addition, batch of additions, update or removal, keeping the items in sync, and
+// return the status of the call. The clusters are only returned by the complete calls.
+inline int random_step(std::mt19937 &generator, Clustering &clustering, std::vector<int> &items, const size_t store_size, Clusters &clusters) {
+    ClusteringResultV2 result;
+    int status;
+    int choice = generator() % 10;
+    auto random_item = [&generator, store_size](){ return generator() % 8 == 0 ? -1 : int(generator() % store_size); };
+    
+    if (!items.empty() && choice < 3) {
+        int idx = generator() % items.size();
+        
+        status = clustering.remove_textual_item(idx, 0, &result);
+        items.erase(items.begin() + idx);
+    } else if (!items.empty() && choice < 4) {
+        int idx = generator() % items.size();
+        int item = random_item();
+        std::string text = item_text(item);
+        
+        status = clustering.remove_textual_item(idx, 1, &result);
+        take_clusters(result);
+        status |= clustering.add_textual_item(text.c_str(), idx, &result);
+        items[idx] = item;
+    } else if (choice < 6) {
+        int count = 1 + generator() % 3;
+        std::vector<std::string> texts;
+        std::vector<const char*> text_pointers;
+        std::vector<int> idxs;
+        std::vector<std::pair<int, int>> inserted;
+        
+        // Distinct positions among the items once all are added, given in any order.
+        while (inserted.size() < count) {
+            int idx = generator() % (items.size() + count);
+            
+            if (std::none_of(inserted.begin(), inserted.end(), [idx](const std::pair<int, int> &item){ return item.first == idx; })) {
+                inserted.push_back(std::make_pair(idx, random_item()));
+            }
+        }
+        
+        for (const std::pair<int, int> &item : inserted) {
+            texts.push_back(item_text(item.second));
+            idxs.push_back(item.first);
+        }
+        
+        std::sort(inserted.begin(), inserted.end());
+        
+        for (const std::pair<int, int> &item : inserted) {
+            items.insert(items.begin() + item.first, item.second);
+        }
+        
+        for (const std::string &text : texts) {
+            text_pointers.push_back(text.c_str());
+        }
+        
+        status = clustering.add_textual_items(text_pointers.data(), idxs.data(), count, &result);
+    } else {
+        int idx = generator() % (items.size() + 1);
+        int item = random_item();
+        std::string text = item_text(item);
+        
+        status = clustering.add_textual_item(text.c_str(), idx, &result);
+        items.insert(items.begin() + idx, item);
+    }
+    
+    clusters = take_clusters(result);
+    
+    return status;
+}
+
+// Clusters of a new clustering of the items, computed at once.
+inline Clusters full_recompute(const std::vector<std::vector<float>> &store, const std::vector<int> &items, const float threshold, const ClusteringStrategy strategy, const SimilarityStorage storage) {
+    std::unique_ptr<Clustering> clustering = make_clustering(store, threshold);
+    std::vector<std::string> texts;
+    std::vector<const char*> text_pointers;
+    std::vector<int> idxs;
+    ClusteringResultV2 result;
+    
+    clustering->set_clustering_strategy(strategy);
+    clustering->set_similarity_storage(storage);
+    
+    for (size_t i = 0;i < items.size();i++) {
+        texts.push_back(item_text(items[i]));
+        idxs.push_back(i);
+    }
+    
+    for (const std::string &text : texts) {
+        text_pointers.push_back(text.c_str());
+    }
+    
+    clustering->add_textual_items(text_pointers.data(), idxs.data(), items.size(), &result);
+    
+    return take_clusters(result);
+}
+// A clustering over embeddings drawn around a few prototypes, driven by random steps, which the
+// tests compare with a reference after each one. The clustering reads the store, so the fixture
+// is neither copied nor moved.
+struct RandomClustering {
+    typedef std::vector<std::vector<float>> (*StoreFunction)(std::mt19937 &generator, const size_t count, const size_t prototypes);
+    
+    std::mt19937 generator;
+    std::vector<std::vector<float>> store;
+    float threshold;
+    ClusteringStrategy strategy;
+    SimilarityStorage storage;
+    std::unique_ptr<Clustering> clustering;
+    std::vector<int> items;
+    Clusters clusters;
+    
+    RandomClustering(const unsigned seed, const float threshold, const ClusteringStrategy strategy, const SimilarityStorage storage, StoreFunction make_store = clustered_embeddings) : generator(seed), store(make_store(this->generator, 200, 5)), threshold(threshold), strategy(strategy), storage(storage), clustering(make_clustering(this->store, threshold)) {
+        CHECK(this->clustering->set_clustering_strategy(strategy) == 0);
+        CHECK(this->clustering->set_similarity_storage(storage) == 0);
+    }
+    RandomClustering(const RandomClustering &other) = delete;
+    
+    void step() { CHECK(random_step(this->generator, *this->clustering, this->items, this->store.size(), this->clusters) == 0); }
+    std::vector<std::vector<float>> embeddings() const { return item_embeddings(this->store, this->items); }
+    Clusters recompute() const { return full_recompute(this->store, this->items, this->threshold, this->strategy, this->storage); }
+};
+
+#endif /* test_support_hpp */
@@ -0,0 +1,315 @@
+//
+//  threshold_tests.cpp
+//
+
+#include "test_support.hpp"
+#include <map>
+
+// Share of the positions where the clusters, encoded by the cluster number of every position as
+// in the results, agree with the expected ones.
+static float position_accuracy(const std::vector<uint32_t> &sizes, const std::vector<uint32_t> &expected_sizes) {
+    std::vector<uint32_t> positions;
+    std::vector<uint32_t> expected_positions;
+    size_t matches = 0;
+    
+    for (size_t k = 0;k < sizes.size();k++) {
+        positions.insert(positions.end(), sizes[k], k);
+    }
+    
+    for (size_t k = 0;k < expected_sizes.size();k++) {
+        expected_positions.insert(expected_positions.end(), expected_sizes[k], k);
+    }
+    
+    for (size_t k = 0;k < positions.size();k++) {
+        matches += positions[k] == expected_positions[k];
+    }
+    
+    return positions.empty() ? 0 : matches / float(positions.size());
+}
+
+// Embeddings of 16 entries of +-1/4 flipping a few signs of a prototype, their similarities are the
+// multiples of 1/8 so the breakpoints are many and tied.
+static std::vector<std::vector<float>> sign_embeddings(std::mt19937 &generator, const size_t count, const size_t prototypes) {
+    std::vector<std::vector<float>> embeddings;
+    
+    for (size_t i = 0;i < count;i++) {
+        std::vector<float> embedding(hidden_size, 0.25);
+        
+        if (i < prototypes) {
+            for (float &entry : embedding) {
+                entry = generator() % 2 ? 0.25 : -0.25;
+            }
+        } else {
+            embedding = embeddings[generator() % prototypes];
+            
+            for (size_t flips = generator() % 6;flips > 0;flips--) {
+                embedding[generator() % hidden_size] *= -1;
+            }
+        }
+        
+        embeddings.push_back(embedding);
+    }
+    
+    return embeddings;
+}
+
+static Clusters brute_force(const std::vector<std::vector<float>> &embeddings, const ClusteringStrategy strategy, const float threshold) {
+    return strategy == CONNECTED_COMPONENTS_CLUSTERING ? brute_force_components(embeddings, threshold) : brute_force_greedy(embeddings, threshold);
+}
+
+// Accuracy of the brute force clusters at a threshold. They only depend on the similarities at or
+// above it and strictly above it, so the accuracy is kept for every count of both.
+class BruteForceAccuracy {
+    private:
+        const std::vector<std::vector<float>> &embeddings;
+        ClusteringStrategy strategy;
+        const std::vector<uint32_t> &expected_sizes;
+        std::vector<float> similarities;
+        std::map<std::pair<size_t, size_t>, float> accuracies;
+    public:
+        BruteForceAccuracy(const std::vector<std::vector<float>> &embeddings, const ClusteringStrategy strategy, const std::vector<uint32_t> &expected_sizes) : embeddings(embeddings), strategy(strategy), expected_sizes(expected_sizes), similarities(1, 0) {
+            for (size_t i = 0;i < embeddings.size();i++) {
+                for (size_t j = i;j < embeddings.size();j++) {
+                    this->similarities.push_back(similarity(embeddings[i], embeddings[j]));
+                }
+            }
+            
+            std::sort(this->similarities.begin(), this->similarities.end());
+        }
+        
+        float operator()(const float threshold) {
+            std::pair<size_t, size_t> key(std::lower_bound(this->similarities.begin(), this->similarities.end(), threshold) - this->similarities.begin(), std::upper_bound(this->similarities.begin(), this->similarities.end(), threshold) - this->similarities.begin());
+            std::map<std::pair<size_t, size_t>, float>::iterator accuracy = this->accuracies.find(key);
+            
+            if (accuracy == this->accuracies.end()) {
+                accuracy = this->accuracies.emplace(key, position_accuracy(brute_force(this->embeddings, this->strategy, threshold).sizes, this->expected_sizes)).first;
+            }
+            
+            return accuracy->second;
+        }
+};
+
+// The former calibration: cluster again at every step of 1e-4 from the floor, keep the first
+// threshold of a strictly better accuracy, stop at a perfect one, and clamp to the floor.
+static std::tuple<float, float> step_sweep(BruteForceAccuracy &brute_force_accuracy, const float floor) {
+    float best_threshold = 0;
+    float best_accuracy = 0;
+    
+    for (float threshold = std::max(0.0001f, floor);threshold < 1.0;threshold += 0.0001) {
+        float accuracy = brute_force_accuracy(threshold);
+        
+        if (accuracy > best_accuracy) {
+            best_threshold = threshold;
+            best_accuracy = accuracy;
+        }
+        
+        if (accuracy == 1) {
+            break;
+        }
+    }
+    
+    return std::make_tuple(std::max(best_threshold, floor), best_accuracy);
+}
+
+// Whether every threshold between the two, both included, gives the accuracy: the sweep takes its
+// threshold in the middle of the range of the best accuracy, which holds the first step reaching it.
+static bool same_accuracy(BruteForceAccuracy &brute_force_accuracy, const float threshold1, const float threshold2, const float accuracy) {
+    std::vector<float> thresholds = {threshold1, threshold2};
+    
+    for (float threshold = std::min(threshold1, threshold2);threshold < std::max(threshold1, threshold2);threshold += 0.0001) {
+        thresholds.push_back(threshold);
+    }
+    
+    return std::all_of(thresholds.begin(), thresholds.end(), [&](const float threshold){ return brute_force_accuracy(threshold) == accuracy; });
+}
+
+// Expected clusters of a store: the clusters at another threshold, so that some threshold matches
+// them exactly, those of other items, or random sizes in any order, whose best accuracies are
+// often tied.
+static std::vector<uint32_t> expected_sizes(std::mt19937 &generator, const std::vector<std::vector<float>> &store, const std::vector<int> &items, const ClusteringStrategy strategy) {
+    int choice = generator() % 3;
+    
+    if (choice == 0) {
+        return brute_force(item_embeddings(store, items), strategy, 0.1 + (generator() % 80) / 100.0).sizes;
+    }
+    
+    if (choice == 1) {
+        std::vector<int> other_items = items;
+        
+        for (int &item : other_items) {
+            item = generator() % 4 == 0 ? int(generator() % store.size()) : item;
+        }
+        
+        return brute_force(item_embeddings(store, other_items), strategy, 0.4659).sizes;
+    }
+    
+    std::vector<uint32_t> sizes;
+    
+    for (size_t remaining = items.size();remaining > 0;) {
+        sizes.push_back(1 + generator() % remaining);
+        remaining -= sizes.back();
+    }
+    
+    return sizes;
+}
+
+// Calibrate the threshold on the expected sizes with the given number of threads.
+static Clusters calibrate(Clustering &clustering, std::vector<uint32_t> sizes, const uint16_t threads) {
+    ClusterDefinitionV2 expected;
+    ClusteringResultV2 result;
+    
+    expected.indices = nullptr;
+    expected.indices_size = 0;
+    expected.clusters_split = sizes.data();
+    expected.clusters_split_size = sizes.size();
+    
+    CHECK(clustering.set_calibration_threads(threads) == 0);
+    CHECK(clustering.recompute_clustering_threshold(&expected, &result) == 0);
+    
+    return take_clusters(result);
+}
+
+// The segments swept by several threads give the threshold and clusters of a single one.
+static void check_threads(Clustering &clustering, const std::vector<uint32_t> &sizes) {
+    Clusters clusters = calibrate(clustering, sizes, 1);
+    float threshold = clustering.get_threshold();
+    
+    for (const uint16_t threads : {2, 4, 7}) {
+        CHECK(calibrate(clustering, sizes, threads) == clusters);
+        CHECK(clustering.get_threshold() == threshold);
+    }
+}
+
+// Calibrate the clustering of the items and check it against the former step sweep.
+static void check_calibration(Clustering &clustering, const std::vector<std::vector<float>> &embeddings, const ClusteringStrategy strategy, const std::vector<uint32_t> &sizes, const float floor) {
+    BruteForceAccuracy brute_force_accuracy(embeddings, strategy, sizes);
+    std::tuple<float, float> expected_best = step_sweep(brute_force_accuracy, floor);
+    
+    check_threads(clustering, sizes);
+    
+    Clusters clusters = calibrate(clustering, sizes, 1);
+    float threshold = clustering.get_threshold();
+    
+    // Without any item, the accuracy is 0 at every threshold and the threshold is the floor.
+    CHECK(threshold >= floor);
+    CHECK(!embeddings.empty() || threshold == std::get<0>(expected_best));
+    CHECK(position_accuracy(clusters.sizes, sizes) == std::get<1>(expected_best));
+    CHECK(same_accuracy(brute_force_accuracy, threshold, std::get<0>(expected_best), std::get<1>(expected_best)));
+    CHECK(clusters == brute_force(embeddings, strategy, threshold));
+}
+
+// The calibration sweeping the sorted similarities finds the accuracy of the former step sweep,
+// at a threshold in the same range of that accuracy, clamped to the floor of the sparse storage,
+// on small random stores.
+static void test_calibration(const ClusteringStrategy strategy, const SimilarityStorage storage, const unsigned seed) {
+    std::mt19937 generator(seed);
+    std::vector<std::vector<float>> store = seed % 2 ? sign_embeddings(generator, 60, 4) : clustered_embeddings(generator, 60, 4);
+    
+    for (int test = 0;test < 6;test++) {
+        std::unique_ptr<Clustering> clustering = make_clustering(store, 0.4659);
+        std::vector<int> items;
+        ClusteringResultV2 result;
+        size_t count = test == 0 ? 0 : 1 + generator() % 25;
+        
+        CHECK(clustering->set_clustering_strategy(strategy) == 0);
+        CHECK(clustering->set_similarity_storage(storage) == 0);
+        
+        for (size_t i = 0;i < count;i++) {
+            items.push_back(generator() % 8 == 0 ? -1 : int(generator() % store.size()));
+            
+            std::string text = item_text(items.back());
+            
+            CHECK(clustering->add_textual_item(text.c_str(), i, &result) == 0);
+            take_clusters(result);
+        }
+        
+        check_calibration(*clustering, item_embeddings(store, items), strategy, expected_sizes(generator, store, items, strategy), storage == SPARSE_SIMILARITIES ? 0.3 : 0);
+    }
+}
+
+// A chain of items, each joining the component of the previous ones at a lower similarity, with
+// the best accuracy reached above every similarity and again once three items are joined: the
+// first step of the former sweep is in the lower range.
+static void test_tied_components(const SimilarityStorage storage) {
+    std::vector<std::vector<float>> store;
+    std::vector<int> items;
+    std::vector<float> prototype(hidden_size, 0.25);
+    size_t flipped = 0;
+    ClusteringResultV2 result;
+    
+    for (size_t flips = 0;flips < 6;flips++) {
+        std::vector<float> embedding = prototype;
+        
+        for (size_t k = 0;k < flips;k++) {
+            embedding[flipped++] *= -1;
+        }
+        
+        store.push_back(embedding);
+    }
+    
+    std::unique_ptr<Clustering> clustering = make_clustering(store, 0.4659);
+    
+    CHECK(clustering->set_clustering_strategy(CONNECTED_COMPONENTS_CLUSTERING) == 0);
+    CHECK(clustering->set_similarity_storage(storage) == 0);
+    
+    for (int item = 0;item < 6;item++) {
+        std::string text = item_text(item);
+        
+        CHECK(clustering->add_textual_item(text.c_str(), item, &result) == 0);
+        take_clusters(result);
+        items.push_back(item);
+    }
+    
+    check_calibration(*clustering, item_embeddings(store, items), CONNECTED_COMPONENTS_CLUSTERING, {1, 1, 3, 1}, storage == SPARSE_SIMILARITIES ? 0.3 : 0);
+}
+
+// Expected clusters found at a threshold low among many distinct similarities, so that the worker
+// of a low segment reaches a perfect accuracy and cancels the workers above while they sweep.
+static void test_cancelled_segments(const ClusteringStrategy strategy, const SimilarityStorage storage, const unsigned seed) {
+    std::mt19937 generator(seed);
+    std::vector<std::vector<float>> store = gaussian_embeddings(generator, 300, 6);
+    std::unique_ptr<Clustering> clustering = make_clustering(store, 0.4659);
+    std::vector<int> items;
+    ClusteringResultV2 result;
+    
+    CHECK(clustering->set_clustering_strategy(strategy) == 0);
+    CHECK(clustering->set_similarity_storage(storage) == 0);
+    
+    for (int item = 0;item < int(store.size());item++) {
+        std::string text = item_text(item);
+        
+        CHECK(clustering->add_textual_item(text.c_str(), item, &result) == 0);
+        take_clusters(result);
+        items.push_back(item);
+    }
+    
+    for (const float threshold : {0.35, 0.5, 0.7}) {
+        Clusters expected = brute_force(item_embeddings(store, items), strategy, threshold);
+        
+        check_threads(*clustering, expected.sizes);
+        CHECK(calibrate(*clustering, expected.sizes, 4).sizes == expected.sizes);
+    }
+}
+
+int main() {
+    for (unsigned seed = 0;seed < 8;seed++) {
+        for (const ClusteringStrategy strategy : {GREEDY_CLUSTERING, CONNECTED_COMPONENTS_CLUSTERING}) {
+            test_calibration(strategy, DENSE_SIMILARITIES, seed);
+            test_calibration(strategy, PACKED_SIMILARITIES, seed);
+            test_calibration(strategy, SPARSE_SIMILARITIES, seed);
+        }
+    }
+    
+    test_tied_components(DENSE_SIMILARITIES);
+    test_tied_components(PACKED_SIMILARITIES);
+    test_tied_components(SPARSE_SIMILARITIES);
+    
+    for (unsigned seed = 0;seed < 3;seed++) {
+        for (const ClusteringStrategy strategy : {GREEDY_CLUSTERING, CONNECTED_COMPONENTS_CLUSTERING}) {
+            test_cancelled_segments(strategy, DENSE_SIMILARITIES, seed);
+            test_cancelled_segments(strategy, SPARSE_SIMILARITIES, seed);
+        }
+    }
+    
+    return failures > 0 ? 1 : 0;
+}
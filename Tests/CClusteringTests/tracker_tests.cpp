@@ -0,0 +1,266 @@
+//
+//  tracker_tests.cpp
+//
+
+#include "test_support.hpp"
+#include <set>
+
+// Cluster ids of the items by position, rebuilt from the delta results alone like a client would.
+class DeltaReplay {
+    private:
+        std::vector<uint32_t> item_ids;
+        std::set<uint32_t> ids;
+        uint64_t version = 0;
+    public:
+        void insert(const int idx) { this->item_ids.insert(this->item_ids.begin() + idx, ClusterTracker::no_cluster); }
+        void erase(const int idx) { this->item_ids.erase(this->item_ids.begin() + idx); }
+        
+        // Apply a delta, which is freed, checking that it is consistent with the previous ones.
+        void apply(ClusteringDeltaResult &result, const bool complete) {
+            const ClusteringDelta &delta = *result.delta;
+            std::set<uint32_t> previous_ids = this->ids;
+            
+            CHECK(delta.version == this->version + complete);
+            this->version = delta.version;
+            
+            for (uint32_t k = 0;k < delta.created_size;k++) {
+                CHECK(previous_ids.count(delta.created_clusters[k]) == 0);
+                this->ids.insert(delta.created_clusters[k]);
+            }
+            
+            for (uint32_t k = 0;k < delta.removed_size;k++) {
+                CHECK(previous_ids.count(delta.removed_clusters[k]) == 1);
+                this->ids.erase(delta.removed_clusters[k]);
+            }
+            
+            for (uint32_t k = 0;k < delta.moved_size;k++) {
+                this->item_ids[delta.moved_items[k]] = delta.moved_clusters[k];
+            }
+            
+            for (uint32_t k = 0;k < delta.merged_size;k++) {
+                CHECK(std::find(delta.removed_clusters, delta.removed_clusters + delta.removed_size, delta.merged_from[k]) != delta.removed_clusters + delta.removed_size);
+                CHECK(previous_ids.count(delta.merged_into[k]) == 1 && this->ids.count(delta.merged_into[k]) == 1);
+            }
+            
+            for (uint32_t k = 0;k < delta.split_size;k++) {
+                CHECK(std::find(delta.created_clusters, delta.created_clusters + delta.created_size, delta.split_into[k]) != delta.created_clusters + delta.created_size);
+                CHECK(previous_ids.count(delta.split_from[k]) == 1 && this->ids.count(delta.split_from[k]) == 1);
+            }
+            
+            if (complete) {
+                CHECK(std::set<uint32_t>(this->item_ids.begin(), this->item_ids.end()) == this->ids);
+            }
+            
+            delete[] delta.moved_items;
+            delete[] delta.moved_clusters;
+            delete[] delta.created_clusters;
+            delete[] delta.removed_clusters;
+            delete[] delta.merged_from;
+            delete[] delta.merged_into;
+            delete[] delta.split_from;
+            delete[] delta.split_into;
+            delete result.delta;
+        }
+        
+        // Cluster of every item designated by its smallest item.
+        std::vector<uint32_t> partition() const {
+            std::vector<uint32_t> labels(this->item_ids.size());
+            
+            for (size_t i = 0;i < this->item_ids.size();i++) {
+                labels[i] = std::find(this->item_ids.begin(), this->item_ids.end(), this->item_ids[i]) - this->item_ids.begin();
+            }
+            
+            return labels;
+        }
+};
+
+// The delta results of random additions, updates and removals, replayed from the start, give the
+// clusters of a clustering returning them in full for the same calls.
+static void test_delta_replay(const ClusteringStrategy strategy, const unsigned seed) {
+    const float threshold = 0.4659;
+    std::mt19937 generator(seed);
+    std::vector<std::vector<float>> store = clustered_embeddings(generator, 200, 5);
+    std::unique_ptr<Clustering> clustering = make_clustering(store, threshold);
+    std::unique_ptr<Clustering> reference = make_clustering(store, threshold);
+    DeltaReplay replay;
+    size_t items = 0;
+    
+    CHECK(clustering->set_clustering_strategy(strategy) == 0);
+    CHECK(reference->set_clustering_strategy(strategy) == 0);
+    
+    for (int step = 0;step < 150;step++) {
+        ClusteringDeltaResult result;
+        ClusteringResultV2 reference_result;
+        int choice = generator() % 10;
+        int item = generator() % 8 == 0 ? -1 : int(generator() % store.size());
+        std::string text = item_text(item);
+        
+        if (items > 0 && choice < 3) {
+            int idx = generator() % items;
+            
+            replay.erase(idx);
+            CHECK(clustering->remove_textual_item(idx, 0, &result) == 0);
+            CHECK(reference->remove_textual_item(idx, 0, &reference_result) == 0);
+            items--;
+        } else if (items > 0 && choice < 4) {
+            int idx = generator() % items;
+            
+            replay.erase(idx);
+            CHECK(clustering->remove_textual_item(idx, 1, &result) == 0);
+            replay.apply(result, false);
+            CHECK(reference->remove_textual_item(idx, 1, &reference_result) == 0);
+            take_clusters(reference_result);
+            replay.insert(idx);
+            CHECK(clustering->add_textual_item(text.c_str(), idx, &result) == 0);
+            CHECK(reference->add_textual_item(text.c_str(), idx, &reference_result) == 0);
+        } else if (choice < 6) {
+            int idxs[2] = {int(generator() % (items + 2)), int(generator() % (items + 1))};
+            std::string other_text = item_text(generator() % store.size());
+            const char* texts[2] = {text.c_str(), other_text.c_str()};
+            
+            idxs[1] += idxs[1] >= idxs[0];
+            replay.insert(std::min(idxs[0], idxs[1]));
+            replay.insert(std::max(idxs[0], idxs[1]));
+            CHECK(clustering->add_textual_items(texts, idxs, 2, &result) == 0);
+            CHECK(reference->add_textual_items(texts, idxs, 2, &reference_result) == 0);
+            items += 2;
+        } else {
+            int idx = generator() % (items + 1);
+            
+            replay.insert(idx);
+            CHECK(clustering->add_textual_item(text.c_str(), idx, &result) == 0);
+            CHECK(reference->add_textual_item(text.c_str(), idx, &reference_result) == 0);
+            items++;
+        }
+        
+        replay.apply(result, true);
+        CHECK(replay.partition() == partition(take_clusters(reference_result)));
+    }
+}
+
+// A batch takes the positions of its items once all are added, in any order. A position out of
+// range or repeated fails the whole batch, which adds nothing and returns an empty delta.
+static void test_batch_positions() {
+    std::mt19937 generator(0);
+    std::vector<std::vector<float>> store = clustered_embeddings(generator, 20, 3);
+    std::unique_ptr<Clustering> clustering = make_clustering(store, 0.4659);
+    std::vector<int> items = {3, 7, 11};
+    const char* texts[3] = {"3", "7", "11"};
+    const char* batch_texts[3] = {"15", "2", "9"};
+    int idxs[3] = {0, 1, 2};
+    ClusteringDeltaResult result;
+    DeltaReplay replay;
+    
+    for (int i = 0;i < 3;i++) {
+        replay.insert(i);
+    }
+    
+    CHECK(clustering->add_textual_items(texts, idxs, 3, &result) == 0);
+    replay.apply(result, true);
+    
+    for (const std::vector<int> &invalid : std::vector<std::vector<int>>{{1, 1, 2}, {0, 6, 2}, {-1, 0, 2}}) {
+        CHECK(clustering->add_textual_items(batch_texts, invalid.data(), 3, &result) == -1);
+        CHECK(result.delta->moved_size == 0 && result.delta->created_size == 0);
+        replay.apply(result, false);
+    }
+    
+    int batch_idxs[3] = {5, 0, 2};
+    
+    items = {2, 3, 9, 7, 11, 15};
+    replay.insert(0);
+    replay.insert(2);
+    replay.insert(5);
+    CHECK(clustering->add_textual_items(batch_texts, batch_idxs, 3, &result) == 0);
+    replay.apply(result, true);
+    CHECK(replay.partition() == partition(full_recompute(store, items, 0.4659, GREEDY_CLUSTERING, DENSE_SIMILARITIES)));
+}
+
+// Random clusterings, some leaving items out, given to the tracker directly: the merges and the
+// splits only involve the clusters alive before the update, and the items that ended in the
+// cluster of the merge came from the merged cluster.
+static void test_tracker_changes(const unsigned seed) {
+    const size_t items = 12;
+    std::mt19937 generator(seed);
+    ClusterTracker tracker;
+    std::vector<uint32_t> item_ids(items, ClusterTracker::no_cluster);
+    std::set<uint32_t> ids;
+    
+    for (size_t i = 0;i < items;i++) {
+        tracker.insert(i);
+    }
+    
+    for (int step = 0;step < 200;step++) {
+        std::vector<std::vector<uint32_t>> clusters(1 + generator() % 5);
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> sizes;
+        ClusterChanges changes;
+        
+        for (uint32_t i = 0;i < items;i++) {
+            if (generator() % 6 != 0) {
+                clusters[generator() % clusters.size()].push_back(i);
+            }
+        }
+        
+        for (const std::vector<uint32_t> &cluster : clusters) {
+            if (!cluster.empty()) {
+                indices.insert(indices.end(), cluster.begin(), cluster.end());
+                sizes.push_back(cluster.size());
+            }
+        }
+        
+        tracker.update(indices, sizes, changes);
+        
+        std::vector<uint32_t> previous_item_ids = item_ids;
+        size_t offset = 0;
+        
+        for (size_t cluster = 0;cluster < sizes.size();cluster++) {
+            for (size_t i = offset;i < offset + sizes[cluster];i++) {
+                item_ids[indices[i]] = tracker.get_cluster_ids()[cluster];
+            }
+            
+            offset += sizes[cluster];
+        }
+        
+        std::set<uint32_t> new_ids(tracker.get_cluster_ids().begin(), tracker.get_cluster_ids().end());
+        std::set<uint32_t> removed(changes.removed_clusters.begin(), changes.removed_clusters.end());
+        std::set<uint32_t> created(changes.created_clusters.begin(), changes.created_clusters.end());
+        
+        CHECK(changes.merged_from.size() == changes.merged_into.size());
+        CHECK(changes.split_from.size() == changes.split_into.size());
+        
+        for (size_t k = 0;k < changes.merged_from.size();k++) {
+            CHECK(removed.count(changes.merged_from[k]) == 1);
+            CHECK(ids.count(changes.merged_into[k]) == 1 && new_ids.count(changes.merged_into[k]) == 1);
+            
+            bool moved = false;
+            
+            for (size_t i = 0;i < items;i++) {
+                moved = moved || (previous_item_ids[i] == changes.merged_from[k] && item_ids[i] == changes.merged_into[k]);
+            }
+            
+            CHECK(moved);
+        }
+        
+        for (size_t k = 0;k < changes.split_from.size();k++) {
+            CHECK(ids.count(changes.split_from[k]) == 1 && new_ids.count(changes.split_from[k]) == 1);
+            CHECK(created.count(changes.split_into[k]) == 1);
+        }
+        
+        ids = new_ids;
+    }
+}
+
+int main() {
+    test_batch_positions();
+    
+    for (unsigned seed = 0;seed < 20;seed++) {
+        test_tracker_changes(seed);
+    }
+    
+    for (unsigned seed = 0;seed < 10;seed++) {
+        test_delta_replay(GREEDY_CLUSTERING, seed);
+        test_delta_replay(CONNECTED_COMPONENTS_CLUSTERING, seed);
+    }
+    
+    return failures > 0 ? 1 : 0;
+}